@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Adaptive sort dispatcher
+ *
+ * sort_auto() looks at the number and size of the elements, their alignment
+ * and a small sample of the input, and hands the array to whichever sort
+ * is fastest for that case on this machine.  The crossover points live in
+ * sort_auto_table; the defaults are conservative and meant to be replaced
+ * by values the benchmark measured (see "client -c").
+ */
+
+#include <linux/atomic.h>
+#include <linux/kernel.h>
+#include <linux/types.h>
+
+#include "sort_impl.h"
+#include "swap.h"
+
+struct sort_auto_table sort_auto_table = {
+    .insertion_max = 12,
+    .heap_min_size = {ULONG_MAX, ULONG_MAX},
+    .presorted_pct = 100,
+    .dup_pct = 25,
+};
+
+/*
+ * Instrumentation: the last strategy chosen, and how often each was.  Async
+ * jobs run sort_auto() on several CPUs at once, hence the atomics.
+ */
+int sort_auto_last = -1;
+atomic64_t sort_auto_stats[NR_SORT_STRATEGIES];
+
+const char *const sort_strategy_names[NR_SORT_STRATEGIES] = {
+    [SORT_INSERTION] = "insertion",
+    [SORT_HEAP] = "heap",
+    [SORT_INTRO] = "intro",
+};
+
+/* Number of adjacent pairs looked at to guess the input shape */
+#define SAMPLE_PAIRS 32
+
+
+/*
+ * Straight insertion sort that gives up after @limit element moves, which
+ * bounds the damage when the sample made the input look more sorted than
+ * it is.  Returns false if it gave up; the array is still a permutation of
+ * the input, just not sorted.
+ */
+static bool insertion_sort(char *base,
+                           size_t num,
+                           size_t size,
+                           cmp_func_t cmp_func,
+                           swap_func_t swap_func,
+                           size_t limit)
+{
+    size_t moves = 0;
+
+    for (size_t i = 1; i < num; i++) {
+        for (char *p = base + i * size;
+             p > base && cmp_func(p - size, p) > 0; p -= size) {
+            do_swap(p - size, p, size, swap_func);
+            if (++moves > limit)
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * sort_insertion - insertion sort an array of elements
+ * @base: pointer to data to sort
+ * @num: number of elements
+ * @size: size of each element
+ * @cmp_func: pointer to comparison function
+ * @swap_func: pointer to swap function or NULL
+ *
+ * O(n^2); only sensible for very small or almost sorted arrays.  Exported
+ * so the benchmark can find the crossover with the other sorts.
+ */
+void sort_insertion(void *base,
+                    size_t num,
+                    size_t size,
+                    cmp_func_t cmp_func,
+                    swap_func_t swap_func)
+{
+    if (num < 2 || !size)
+        return;
+    if (!swap_func)
+        swap_func = select_swap(base, size);
+    insertion_sort(base, num, size, cmp_func, swap_func, SIZE_MAX);
+}
+
+static void sort_auto_record(enum sort_strategy s)
+{
+    WRITE_ONCE(sort_auto_last, s);
+    atomic64_inc(&sort_auto_stats[s]);
+}
+
+/**
+ * sort_auto - sort an array with the strategy best suited to it
+ * @base: pointer to data to sort
+ * @num: number of elements
+ * @size: size of each element
+ * @cmp_func: pointer to comparison function
+ * @swap_func: pointer to swap function or NULL
+ *
+ * The decision, in order:
+ * - at most insertion_max elements: insertion sort;
+ * - at least presorted_pct percent of the sampled pairs in order: insertion
+ *   sort limited to O(n) moves, finishing with introsort if that runs out;
+ * - at least dup_pct percent of the sampled pairs equal: introsort, whose
+ *   partitioning copes well with duplicates;
+ * - elements at least heap_min_size bytes (indexed by whether they can be
+ *   swapped a word at a time): heapsort;
+ * - anything else: introsort.
+ *
+ * The sample costs at most SAMPLE_PAIRS comparisons.
+ */
+void sort_auto(void *base,
+               size_t num,
+               size_t size,
+               cmp_func_t cmp_func,
+               swap_func_t swap_func)
+{
+    const struct sort_auto_table *t = &sort_auto_table;
+    unsigned int pairs = 0, asc = 0, eq = 0;
+    bool aligned;
+
+    if (num < 2 || !size)
+        return;
+
+    if (num <= t->insertion_max) {
+        sort_insertion(base, num, size, cmp_func, swap_func);
+        sort_auto_record(SORT_INSERTION);
+        return;
+    }
+
+    /* Evenly spaced adjacent pairs: how sorted, how many duplicates */
+    for (size_t i = 0, step = max_t(size_t, (num - 1) / SAMPLE_PAIRS, 1);
+         i + 1 < num && pairs < SAMPLE_PAIRS; i += step, pairs++) {
+        int c = cmp_func((char *) base + i * size,
+                         (char *) base + (i + 1) * size);
+        asc += c <= 0;
+        eq += c == 0;
+    }
+
+    if (asc * 100 >= t->presorted_pct * pairs) {
+        if (insertion_sort(base, num, size, cmp_func,
+                           swap_func ? swap_func : select_swap(base, size),
+                           num)) {
+            sort_auto_record(SORT_INSERTION);
+            return;
+        }
+    } else if (eq * 100 < t->dup_pct * pairs) {
+        aligned = is_aligned(base, size, 4);
+        if (size >= t->heap_min_size[!aligned]) {
+            sort_heap(base, num, size, cmp_func, swap_func);
+            sort_auto_record(SORT_HEAP);
+            return;
+        }
+    }
+
+    sort_intro(base, num, size, cmp_func, swap_func);
+    sort_auto_record(SORT_INTRO);
+}
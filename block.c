@@ -0,0 +1,615 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Block merge sort: a stable, in-place O(n log n) sort for the Linux kernel
+ *
+ * This follows Andrey Astrelin's GrailSort.  About 2*sqrt(n) distinct
+ * elements are collected at the front of the array.  sqrt(n) of them are
+ * used as an internal merge buffer, the others as keys that remember which
+ * run each block came from.  Runs are merged pairwise by selection-sorting
+ * their sqrt(n)-sized blocks on the first element (ties broken by key, so
+ * the merge stays stable) and merging neighbouring blocks through the
+ * buffer.  At the end the buffer is sorted and merged back into the data.
+ *
+ * Only a constant amount of stack is used and nothing is allocated.  If the
+ * input has too few distinct elements, smaller buffers are used, down to
+ * rotation-based merges with no buffer at all.
+ */
+
+#include <linux/types.h>
+
+#include "sort_impl.h"
+#include "swap.h"
+
+struct grail {
+    ptrdiff_t size;
+    cmp_func_t cmp;
+    swap_func_t swap;
+    swap_func_t swap_run; /* built-in swap for runs of elements, or NULL */
+};
+
+#define idx(x) ((ptrdiff_t)(x) * g->size) /* manual indexing */
+
+static inline void grail_swap1(const struct grail *g, char *a, char *b)
+{
+    do_swap(a, b, g->size, g->swap);
+}
+
+/*
+ * Swap two runs of n elements.  With the built-in swaps, disjoint runs are
+ * exchanged in a single call; overlapping runs (as left by the merges below)
+ * must go element by element, front to back.
+ */
+static void grail_swapN(const struct grail *g, char *a, char *b, long n)
+{
+    if (n <= 0)
+        return;
+    if (g->swap_run && (a + idx(n) <= b || b + idx(n) <= a)) {
+        do_swap(a, b, idx(n), idx(n) >= SWAP_BLOCK_MIN ? SWAP_BLOCK
+                                                         : g->swap_run);
+        return;
+    }
+    while (n--) {
+        grail_swap1(g, a, b);
+        a += g->size;
+        b += g->size;
+    }
+}
+
+/* Exchange the adjacent runs a[0, l1) and a[l1, l1 + l2) */
+static void grail_rotate(const struct grail *g, char *a, long l1, long l2)
+{
+    while (l1 && l2) {
+        if (l1 <= l2) {
+            grail_swapN(g, a, a + idx(l1), l1);
+            a += idx(l1);
+            l2 -= l1;
+        } else {
+            grail_swapN(g, a + idx(l1 - l2), a + idx(l1), l2);
+            l1 -= l2;
+        }
+    }
+}
+
+/* Index of the first element of arr[0, len) that is >= key */
+static long grail_search_left(const struct grail *g,
+                              char *arr,
+                              long len,
+                              const char *key)
+{
+    long a = -1, b = len, c;
+
+    while (a < b - 1) {
+        c = a + ((b - a) >> 1);
+        if (g->cmp(arr + idx(c), key) >= 0)
+            b = c;
+        else
+            a = c;
+    }
+    return b;
+}
+
+/* Index of the first element of arr[0, len) that is > key */
+static long grail_search_right(const struct grail *g,
+                               char *arr,
+                               long len,
+                               const char *key)
+{
+    long a = -1, b = len, c;
+
+    while (a < b - 1) {
+        c = a + ((b - a) >> 1);
+        if (g->cmp(arr + idx(c), key) > 0)
+            b = c;
+        else
+            a = c;
+    }
+    return b;
+}
+
+/*
+ * "a comes before b" when merging a run of type @ftype.  Equal elements
+ * keep the order of the runs: left run first when ftype is 0, right run
+ * first when it is 1.
+ */
+static inline bool grail_before(int c, int ftype)
+{
+    return ftype ? c <= 0 : c < 0;
+}
+
+static void grail_insert_sort(const struct grail *g, char *arr, long len)
+{
+    for (long i = 1; i < len; i++) {
+        for (long j = i - 1;
+             j >= 0 && g->cmp(arr + idx(j), arr + idx(j + 1)) > 0; j--)
+            grail_swap1(g, arr + idx(j), arr + idx(j + 1));
+    }
+}
+
+/**
+ * grail_find_keys - gather distinct elements at the front of the array
+ * @g: sort parameters
+ * @arr: data
+ * @len: number of elements
+ * @nkeys: number of distinct elements wanted
+ *
+ * The first occurrence of up to @nkeys distinct values is moved, sorted,
+ * to the front of @arr; everything else keeps its relative order.
+ * Returns the number of keys found.  Cost is O(len + nkeys^2) moves.
+ */
+static long grail_find_keys(const struct grail *g,
+                            char *arr,
+                            long len,
+                            long nkeys)
+{
+    long h = 1, h0 = 0, u = 1, r;
+
+    while (u < len && h < nkeys) {
+        r = grail_search_left(g, arr + idx(h0), h, arr + idx(u));
+        if (r == h || g->cmp(arr + idx(u), arr + idx(h0 + r)) != 0) {
+            grail_rotate(g, arr + idx(h0), h, u - (h0 + h));
+            h0 = u - h;
+            grail_rotate(g, arr + idx(h0 + r), h - r, 1);
+            h++;
+        }
+        u++;
+    }
+    grail_rotate(g, arr, h0, h);
+    return h;
+}
+
+/* Stable merge of arr[0, len1) and arr[len1, len1 + len2) by rotations */
+static void grail_merge_without_buffer(const struct grail *g,
+                                       char *arr,
+                                       long len1,
+                                       long len2)
+{
+    long h;
+
+    if (len1 < len2) {
+        while (len1) {
+            h = grail_search_left(g, arr + idx(len1), len2, arr);
+            if (h) {
+                grail_rotate(g, arr, len1, h);
+                arr += idx(h);
+                len2 -= h;
+            }
+            if (!len2)
+                break;
+            do {
+                arr += g->size;
+                len1--;
+            } while (len1 && g->cmp(arr, arr + idx(len1)) <= 0);
+        }
+    } else {
+        while (len2) {
+            h = grail_search_right(g, arr, len1, arr + idx(len1 + len2 - 1));
+            if (h != len1) {
+                grail_rotate(g, arr + idx(h), len1 - h, len2);
+                len1 = h;
+            }
+            if (!len1)
+                break;
+            do {
+                len2--;
+            } while (len2 && g->cmp(arr + idx(len1 - 1),
+                                    arr + idx(len1 + len2 - 1)) <= 0);
+        }
+    }
+}
+
+/*
+ * Merge arr[0, l1) and arr[l1, l1 + l2) into arr[m, m + l1 + l2) through
+ * the buffer arr[m, 0), m < 0.  The buffer ends up behind the result.
+ */
+static void grail_merge_left(const struct grail *g,
+                             char *arr,
+                             long l1,
+                             long l2,
+                             long m)
+{
+    long p0 = 0, p1 = l1;
+
+    l2 += l1;
+    while (p1 < l2) {
+        if (p0 == l1 || g->cmp(arr + idx(p0), arr + idx(p1)) > 0)
+            grail_swap1(g, arr + idx(m++), arr + idx(p1++));
+        else
+            grail_swap1(g, arr + idx(m++), arr + idx(p0++));
+    }
+    if (m != p0)
+        grail_swapN(g, arr + idx(m), arr + idx(p0), l1 - p0);
+}
+
+/*
+ * Mirror image of grail_merge_left(): the buffer arr[l1 + l2, l1 + l2 + m)
+ * follows the runs, and the result is written to arr[m, m + l1 + l2).
+ */
+static void grail_merge_right(const struct grail *g,
+                              char *arr,
+                              long l1,
+                              long l2,
+                              long m)
+{
+    long p0 = l1 + l2 + m - 1, p2 = l1 + l2 - 1, p1 = l1 - 1;
+
+    while (p1 >= 0) {
+        if (p2 < l1 || g->cmp(arr + idx(p1), arr + idx(p2)) > 0)
+            grail_swap1(g, arr + idx(p0--), arr + idx(p1--));
+        else
+            grail_swap1(g, arr + idx(p0--), arr + idx(p2--));
+    }
+    if (p2 != p0) {
+        while (p2 >= l1)
+            grail_swap1(g, arr + idx(p0--), arr + idx(p2--));
+    }
+}
+
+/*
+ * Merge the unfinished tail arr[0, *alen1) of a run of type *atype with the
+ * next block arr[*alen1, *alen1 + len2) of the other run, through the
+ * buffer at arr[-lkeys, 0).  Whatever is left of the run that did not run
+ * out is moved to the end and becomes the new tail.
+ */
+static void grail_smart_merge_with_buffer(const struct grail *g,
+                                          char *arr,
+                                          long *alen1,
+                                          int *atype,
+                                          long len2,
+                                          long lkeys)
+{
+    long p0 = -lkeys, p1 = 0, p2 = *alen1, q1 = p2, q2 = p2 + len2;
+    int ftype = 1 - *atype;
+
+    while (p1 < q1 && p2 < q2) {
+        if (grail_before(g->cmp(arr + idx(p1), arr + idx(p2)), ftype))
+            grail_swap1(g, arr + idx(p0++), arr + idx(p1++));
+        else
+            grail_swap1(g, arr + idx(p0++), arr + idx(p2++));
+    }
+    if (p1 < q1) {
+        *alen1 = q1 - p1;
+        while (p1 < q1)
+            grail_swap1(g, arr + idx(--q1), arr + idx(--q2));
+    } else {
+        *alen1 = q2 - p2;
+        *atype = ftype;
+    }
+}
+
+/* As above, but merging in place with rotations */
+static void grail_smart_merge_without_buffer(const struct grail *g,
+                                             char *arr,
+                                             long *alen1,
+                                             int *atype,
+                                             long len2)
+{
+    long len1 = *alen1, h;
+    int ftype = 1 - *atype;
+
+    if (!len2)
+        return;
+    if (len1 && !grail_before(g->cmp(arr + idx(len1 - 1), arr + idx(len1)),
+                              ftype)) {
+        while (len1) {
+            h = ftype ? grail_search_left(g, arr + idx(len1), len2, arr)
+                      : grail_search_right(g, arr + idx(len1), len2, arr);
+            if (h) {
+                grail_rotate(g, arr, len1, h);
+                arr += idx(h);
+                len2 -= h;
+            }
+            if (!len2) {
+                *alen1 = len1;
+                return;
+            }
+            do {
+                arr += g->size;
+                len1--;
+            } while (len1 &&
+                     grail_before(g->cmp(arr, arr + idx(len1)), ftype));
+        }
+    }
+    *alen1 = len2;
+    *atype = ftype;
+}
+
+/**
+ * grail_build_blocks - sort arr[0, len) into runs of 2*k elements
+ * @g: sort parameters
+ * @arr: data, preceded by a k-element buffer at arr[-k, 0)
+ * @len: number of elements
+ * @k: buffer size, a power of two >= 2
+ *
+ * On return the buffer is at arr[-k, 0) again (its order is lost) and
+ * arr[0, len) consists of sorted runs of 2*k elements plus a sorted tail.
+ */
+static void grail_build_blocks(const struct grail *g,
+                               char *arr,
+                               long len,
+                               long k)
+{
+    long m, u, h, p0, p1, rest, restk, p;
+
+    for (m = 1; m < len; m += 2) {
+        u = g->cmp(arr + idx(m - 1), arr + idx(m)) > 0;
+        grail_swap1(g, arr + idx(m - 3), arr + idx(m - 1 + u));
+        grail_swap1(g, arr + idx(m - 2), arr + idx(m - u));
+    }
+    if (len % 2)
+        grail_swap1(g, arr + idx(len - 1), arr + idx(len - 3));
+    arr -= idx(2);
+    for (h = 2; h < k; h *= 2) {
+        p0 = 0;
+        p1 = len - 2 * h;
+        while (p0 <= p1) {
+            grail_merge_left(g, arr + idx(p0), h, h, -h);
+            p0 += 2 * h;
+        }
+        rest = len - p0;
+        if (rest > h)
+            grail_merge_left(g, arr + idx(p0), h, rest - h, -h);
+        else
+            grail_rotate(g, arr + idx(p0 - h), h, rest);
+        arr -= idx(h);
+    }
+    restk = len % (2 * k);
+    p = len - restk;
+    if (restk <= k)
+        grail_rotate(g, arr + idx(p), restk, k);
+    else
+        grail_merge_right(g, arr + idx(p), k, restk - k, k);
+    while (p > 0) {
+        p -= 2 * k;
+        grail_merge_right(g, arr + idx(p), k, k, k);
+    }
+}
+
+/* Merge the selection-sorted blocks of one pair of runs, see below */
+static void grail_merge_buffers_left(const struct grail *g,
+                                     char *keys,
+                                     char *midkey,
+                                     char *arr,
+                                     long nblock,
+                                     long lblock,
+                                     bool havebuf,
+                                     long nblock2,
+                                     long llast)
+{
+    long l, prest, lrest, pidx, cidx;
+    int frest, fnext;
+
+    if (!nblock) {
+        l = nblock2 * lblock;
+        if (havebuf)
+            grail_merge_left(g, arr, l, llast, -lblock);
+        else
+            grail_merge_without_buffer(g, arr, l, llast);
+        return;
+    }
+
+    lrest = lblock;
+    frest = g->cmp(keys, midkey) >= 0;
+    pidx = lblock;
+    for (cidx = 1; cidx < nblock; cidx++, pidx += lblock) {
+        prest = pidx - lrest;
+        fnext = g->cmp(keys + idx(cidx), midkey) >= 0;
+        if (fnext == frest) {
+            if (havebuf)
+                grail_swapN(g, arr + idx(prest - lblock), arr + idx(prest),
+                            lrest);
+            lrest = lblock;
+        } else if (havebuf) {
+            grail_smart_merge_with_buffer(g, arr + idx(prest), &lrest, &frest,
+                                          lblock, lblock);
+        } else {
+            grail_smart_merge_without_buffer(g, arr + idx(prest), &lrest,
+                                             &frest, lblock);
+        }
+    }
+    prest = pidx - lrest;
+    if (llast) {
+        if (frest) {
+            if (havebuf)
+                grail_swapN(g, arr + idx(prest - lblock), arr + idx(prest),
+                            lrest);
+            prest = pidx;
+            lrest = lblock * nblock2;
+        } else {
+            lrest += lblock * nblock2;
+        }
+        if (havebuf)
+            grail_merge_left(g, arr + idx(prest), lrest, llast, -lblock);
+        else
+            grail_merge_without_buffer(g, arr + idx(prest), lrest, llast);
+    } else if (havebuf) {
+        grail_swapN(g, arr + idx(prest), arr + idx(prest - lblock), lrest);
+    }
+}
+
+/**
+ * grail_combine_blocks - merge neighbouring sorted runs pairwise
+ * @g: sort parameters
+ * @keys: distinct elements used to tag blocks
+ * @arr: data; if @havebuf, preceded by an @lblock-element buffer
+ * @len: number of elements
+ * @ll: run length; runs of 2*@ll elements are produced
+ * @lblock: block length; @ll and @lblock are powers of two
+ * @havebuf: whether a merge buffer is available
+ *
+ * At least 2*@ll/@lblock + 1 keys are required.
+ */
+static void grail_combine_blocks(const struct grail *g,
+                                 char *keys,
+                                 char *arr,
+                                 long len,
+                                 long ll,
+                                 long lblock,
+                                 bool havebuf)
+{
+    long m, b, nblk, midkey, lrest, u, p, v, nbl2, llast;
+    char *arr1;
+    int kc;
+
+    m = len / (2 * ll);
+    lrest = len % (2 * ll);
+    if (lrest <= ll) {
+        len -= lrest;
+        lrest = 0;
+    }
+    for (b = 0; b <= m; b++) {
+        if (b == m && !lrest)
+            break;
+        arr1 = arr + idx(b * 2 * ll);
+        nblk = (b == m ? lrest : 2 * ll) / lblock;
+        grail_insert_sort(g, keys, nblk + (b == m ? 1 : 0));
+        midkey = ll / lblock;
+        /* selection sort of the blocks, tagging each with its key */
+        for (u = 1; u < nblk; u++) {
+            p = u - 1;
+            for (v = u; v < nblk; v++) {
+                kc = g->cmp(arr1 + idx(p * lblock), arr1 + idx(v * lblock));
+                if (kc > 0 ||
+                    (!kc && g->cmp(keys + idx(p), keys + idx(v)) > 0))
+                    p = v;
+            }
+            if (p != u - 1) {
+                grail_swapN(g, arr1 + idx((u - 1) * lblock),
+                            arr1 + idx(p * lblock), lblock);
+                grail_swap1(g, keys + idx(u - 1), keys + idx(p));
+                if (midkey == u - 1 || midkey == p)
+                    midkey ^= (u - 1) ^ p;
+            }
+        }
+        nbl2 = llast = 0;
+        if (b == m)
+            llast = lrest % lblock;
+        if (llast) {
+            while (nbl2 < nblk &&
+                   g->cmp(arr1 + idx(nblk * lblock),
+                          arr1 + idx((nblk - nbl2 - 1) * lblock)) < 0)
+                nbl2++;
+        }
+        grail_merge_buffers_left(g, keys, keys + idx(midkey), arr1,
+                                 nblk - nbl2, lblock, havebuf, nbl2, llast);
+    }
+    /* the merges left the buffer at the end; move it back in front */
+    if (havebuf) {
+        while (--len >= 0)
+            grail_swap1(g, arr + idx(len), arr + idx(len - lblock));
+    }
+}
+
+/* Buffer-less bottom-up merge sort for inputs with very few distinct keys */
+static void grail_lazy_stable_sort(const struct grail *g, char *arr, long len)
+{
+    long m, h, p0, p1, rest;
+
+    for (m = 1; m < len; m += 2) {
+        if (g->cmp(arr + idx(m - 1), arr + idx(m)) > 0)
+            grail_swap1(g, arr + idx(m - 1), arr + idx(m));
+    }
+    for (h = 2; h < len; h *= 2) {
+        p0 = 0;
+        p1 = len - 2 * h;
+        while (p0 <= p1) {
+            grail_merge_without_buffer(g, arr + idx(p0), h, h);
+            p0 += 2 * h;
+        }
+        rest = len - p0;
+        if (rest > h)
+            grail_merge_without_buffer(g, arr + idx(p0), h, rest - h);
+    }
+}
+
+static void grail_sort(const struct grail *g, char *arr, long len)
+{
+    long lblock, lkeys, findkeys, ptr, cbuf, lb, nk, s;
+    bool havebuf, chavebuf;
+
+    if (len < 16) {
+        grail_insert_sort(g, arr, len);
+        return;
+    }
+
+    lblock = 1;
+    while (lblock * lblock < len)
+        lblock *= 2;
+    lkeys = (len - 1) / lblock + 1;
+    findkeys = grail_find_keys(g, arr, len, lkeys + lblock);
+    havebuf = true;
+    if (findkeys < lkeys + lblock) {
+        if (findkeys < 4) {
+            grail_lazy_stable_sort(g, arr, len);
+            return;
+        }
+        lkeys = lblock;
+        while (lkeys > findkeys)
+            lkeys /= 2;
+        havebuf = false;
+        lblock = 0;
+    }
+    ptr = lblock + lkeys;
+    cbuf = havebuf ? lblock : lkeys;
+    grail_build_blocks(g, arr + idx(ptr), len - ptr, cbuf);
+
+    /* runs of 2*cbuf elements are sorted now */
+    while (len - ptr > (cbuf *= 2)) {
+        lb = lblock;
+        chavebuf = havebuf;
+        if (!havebuf) {
+            /* borrow half of the keys as a (smaller) buffer if possible */
+            if (lkeys > 4 && lkeys / 8 * lkeys >= cbuf) {
+                lb = lkeys / 2;
+                chavebuf = true;
+            } else {
+                nk = 1;
+                s = cbuf * findkeys / 2;
+                while (nk < lkeys && s) {
+                    nk *= 2;
+                    s /= 8;
+                }
+                lb = (2 * cbuf) / nk;
+            }
+        }
+        grail_combine_blocks(g, arr, arr + idx(ptr), len - ptr, cbuf, lb,
+                             chavebuf);
+    }
+    grail_insert_sort(g, arr, ptr);
+    grail_merge_without_buffer(g, arr, ptr, len - ptr);
+}
+
+/**
+ * sort_block - stable in-place sort of an array of elements
+ * @base: pointer to data to sort
+ * @num: number of elements
+ * @size: size of each element
+ * @cmp_func: pointer to comparison function
+ * @swap_func: pointer to swap function or NULL
+ *
+ * Elements comparing equal keep their relative order.  The sort takes
+ * O(n log n) time and O(1) extra memory: elements are only ever moved by
+ * swapping, so there is no temporary element and nothing is allocated.
+ */
+void sort_block(void *base,
+                size_t num,
+                size_t size,
+                cmp_func_t cmp_func,
+                swap_func_t swap_func)
+{
+    struct grail g = {
+        .size = size,
+        .cmp = cmp_func,
+        .swap = swap_func,
+        .swap_run = NULL,
+    };
+
+    if (num < 2 || !size)
+        return;
+
+    if (!swap_func) {
+        g.swap = select_swap(base, size);
+        g.swap_run = select_swap_words(base, size);
+    }
+
+    grail_sort(&g, base, num);
+}
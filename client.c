@@ -1,4 +1,6 @@
 #include <fcntl.h>
+#include <math.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,26 +8,797 @@
 #include <time.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <sys/ioctl.h>
+
+#include "sort_ioctl.h"
 
 #define LEN 20000
+#define POINTS_PER_OCTAVE 8
 #define SORT_DEV "/dev/sort_test"
+#define MAX_LEN_PARAM "/sys/module/sort_test/parameters/max_len"
+#define PARAM_DIR "/sys/module/sort_test/parameters/"
+#define CROSSOVER_FILE "crossover.conf"
+
+/* Columns of the timing output, bits of algo_mask */
+enum {
+    HEAP,
+    INTRO,
+    BLOCK,
+    INSERTION,
+    AUTO,
+    KV_INTRO,
+    KV_RADIX,
+    SWAP,
+    SWAP_WORDS,
+    LIST,
+    LIST_GATHER,
+    UNIQUE,
+    DEDUP,
+    DECIMAL_INTRO,
+    DECIMAL_PREFIX,
+    NR_ALGOS
+};
+/* heap, intro, block, auto, kv intro and kv radix; no benchmark-only columns */
+#define DEFAULT_ALGOS "0x77"
+
+static const char *const strategy_names[] = {"insertion", "heap", "intro"};
+
+/* Largest size the loaded module accepts, or LEN if it can't be read */
+static uint64_t module_max_len(void)
+{
+    uint64_t len = LEN;
+    FILE *f = fopen(MAX_LEN_PARAM, "r");
+    if (f) {
+        if (fscanf(f, "%lu", &len) != 1)
+            len = LEN;
+        fclose(f);
+    }
+    return len;
+}
+
+static void set_param(const char *name, const char *val)
+{
+    char path[128];
+    snprintf(path, sizeof(path), PARAM_DIR "%s", name);
+    FILE *f = fopen(path, "w");
+    if (!f || fprintf(f, "%s\n", val) < 0 || fclose(f)) {
+        perror(path);
+        exit(1);
+    }
+}
+
+static long get_param(const char *name)
+{
+    char path[128];
+    long val = -1;
+    snprintf(path, sizeof(path), PARAM_DIR "%s", name);
+    FILE *f = fopen(path, "r");
+    if (f) {
+        if (fscanf(f, "%ld", &val) != 1)
+            val = -1;
+        fclose(f);
+    }
+    return val;
+}
+
+static void set_param_ul(const char *name, unsigned long val)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lu", val);
+    set_param(name, buf);
+}
+
+/* Sort n elements with the algorithms in algo_mask; returns the times */
+static void run(int fd, uint64_t n, uint64_t res[2][NR_ALGOS])
+{
+    lseek(fd, n - 1, SEEK_SET);
+    if (read(fd, res, sizeof(uint64_t[2][NR_ALGOS])) < 0) {
+        perror("sort failed");
+        exit(1);
+    }
+}
+
+#define CALIB_NUM 4096
+#define CALIB_MAX_SIZE 1024
+
+/*
+ * First element size (aligned if @offset is 0, odd-sized otherwise) at
+ * which heapsort beats introsort, or ULONG_MAX if it never does.
+ */
+static unsigned long heap_crossover(int fd, unsigned long offset)
+{
+    uint64_t res[2][NR_ALGOS];
+
+    for (unsigned long size = 8; size <= CALIB_MAX_SIZE; size *= 2) {
+        set_param_ul("elem_size", size + offset);
+        run(fd, CALIB_NUM, res);
+        if (res[0][HEAP] <= res[0][INTRO])
+            return size + offset;
+    }
+    return (unsigned long) -1;
+}
+
+/*
+ * Measure the sort_auto() crossover table on this machine, load it into the
+ * module and save it to CROSSOVER_FILE, from where "make load" picks it up.
+ * The presorted and duplicate thresholds are properties of the input, not
+ * of the machine, and keep their defaults.
+ */
+static void calibrate(int fd)
+{
+    uint64_t res[2][NR_ALGOS];
+    unsigned long insertion_max = 1, heap_min[2];
+    int losses = 0;
+
+    set_param("dist", "0");
+    set_param("elem_size", "8");
+
+    /* insertion sort vs introsort; stop after a few losses in a row */
+    set_param_ul("algo_mask", 1 << INSERTION | 1 << INTRO);
+    set_param("repeat", "1000");
+    for (unsigned long n = 2; n <= 64 && losses < 4; n++) {
+        run(fd, n, res);
+        if (res[0][INSERTION] <= res[0][INTRO]) {
+            insertion_max = n;
+            losses = 0;
+        } else {
+            losses++;
+        }
+    }
+
+    /* heapsort vs introsort by element size */
+    set_param_ul("algo_mask", 1 << HEAP | 1 << INTRO);
+    set_param("repeat", "10");
+    heap_min[0] = heap_crossover(fd, 0);
+    heap_min[1] = heap_crossover(fd, 1);
+
+    set_param("elem_size", "8");
+    set_param("repeat", "1");
+    set_param("algo_mask", DEFAULT_ALGOS);
+
+    char heap[48], table[128];
+    snprintf(heap, sizeof(heap), "%lu,%lu", heap_min[0], heap_min[1]);
+    snprintf(table, sizeof(table),
+             "auto_insertion_max=%lu auto_heap_min_size=%s", insertion_max,
+             heap);
+    set_param_ul("auto_insertion_max", insertion_max);
+    set_param("auto_heap_min_size", heap);
+
+    FILE *f = fopen(CROSSOVER_FILE, "w");
+    if (!f) {
+        perror(CROSSOVER_FILE);
+        exit(1);
+    }
+    fprintf(f, "%s\n", table);
+    fclose(f);
+    printf("%s\n", table);
+}
+
+#define SWAP_NUM 100000
+
+/*
+ * Swap kernels by element size: the time per swap with the swap the sorts
+ * select and with the plain word loop, then heapsort and introsort with
+ * swap_specialize on and off, one line per size in swap.txt.
+ */
+static void swap_sweep(int fd, uint64_t num)
+{
+    static const unsigned long sizes[] = {16,  24,  32,  48,  64,
+                                          128, 256, 512, 1024};
+    uint64_t res[2][NR_ALGOS], plain[2][NR_ALGOS];
+    FILE *out = fopen("swap.txt", "w");
+
+    if (!out) {
+        perror("swap.txt");
+        exit(1);
+    }
+    set_param("repeat", "5");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+        set_param_ul("elem_size", sizes[i]);
+        set_param("swap_specialize", "1");
+        set_param_ul("algo_mask",
+                     1 << HEAP | 1 << INTRO | 1 << SWAP | 1 << SWAP_WORDS);
+        run(fd, num, res);
+        set_param("swap_specialize", "0");
+        set_param_ul("algo_mask", 1 << HEAP | 1 << INTRO);
+        run(fd, num, plain);
+        fprintf(out, "%lu %.2f %.2f %lu %lu %lu %lu\n", sizes[i],
+                (double) res[0][SWAP] / num, (double) res[0][SWAP_WORDS] / num,
+                res[0][HEAP], plain[0][HEAP], res[0][INTRO], plain[0][INTRO]);
+    }
+    set_param("swap_specialize", "1");
+    set_param("elem_size", "8");
+    set_param("repeat", "1");
+    set_param("algo_mask", DEFAULT_ALGOS);
+    fclose(out);
+}
+
+/*
+ * Regression suite: every sort over fixed seeds, sizes and distributions.
+ * Comparison and swap counts only depend on the input, so they must match
+ * the baseline exactly.  Times are noisy: SUITE_RUNS samples are kept per
+ * case, and a case is slower only if a one-sided Mann-Whitney U test says
+ * so at SUITE_ALPHA and the median grew by more than the threshold.
+ */
+#define SUITE_RUNS 11
+#define SUITE_ALPHA 0.01
+#define SUITE_THRESHOLD 5.0 /* percent */
+#define SUITE_ALGOS \
+    ((1 << NR_ALGOS) - 1 - (1 << SWAP) - (1 << SWAP_WORDS))
+
+static const char *const algo_names[NR_ALGOS] = {
+    "heap",   "intro", "block", "insertion", "auto",
+    "kv-intro", "kv-radix", "swap", "swap-words", "list",
+    "list-gather", "unique", "dedup", "decimal-intro", "decimal-prefix",
+};
+static const uint64_t suite_seeds[] = {1, 2, 3};
+static const uint64_t suite_sizes[] = {10, 100, 1000, 10000};
+#define SUITE_DISTS 5
+
+/* Bump when the counts change meaning, so old baselines get regenerated */
+#define SUITE_VERSION "sort_test baseline v2"
+
+struct suite_case {
+    int algo;
+    uint64_t seed, n, cmps, moves;
+    int dist;
+    uint64_t t[SUITE_RUNS];
+};
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t median(const uint64_t *t)
+{
+    uint64_t s[SUITE_RUNS];
+
+    memcpy(s, t, sizeof(s));
+    qsort(s, SUITE_RUNS, sizeof(*s), cmp_u64);
+    return s[SUITE_RUNS / 2];
+}
+
+/*
+ * p-value of "the new times are larger than the old ones": the normal
+ * approximation of the U statistic, with tie and continuity corrections.
+ */
+static double mann_whitney_p(const uint64_t *old, const uint64_t *new)
+{
+    const int n = SUITE_RUNS, total = 2 * SUITE_RUNS;
+    struct {
+        uint64_t t;
+        int is_new;
+    } all[2 * SUITE_RUNS];
+    double rank_new = 0, ties = 0;
+
+    for (int i = 0; i < n; i++) {
+        all[i].t = old[i], all[i].is_new = 0;
+        all[n + i].t = new[i], all[n + i].is_new = 1;
+    }
+    /* insertion sort by time; 22 elements */
+    for (int i = 1; i < total; i++) {
+        for (int j = i; j > 0 && all[j - 1].t > all[j].t; j--) {
+            __typeof__(all[0]) tmp = all[j];
+            all[j] = all[j - 1];
+            all[j - 1] = tmp;
+        }
+    }
+    for (int i = 0; i < total;) {
+        int j = i;
+        while (j < total && all[j].t == all[i].t)
+            j++;
+        /* ranks i+1..j share their mean */
+        for (int k = i; k < j; k++)
+            rank_new += all[k].is_new ? (i + 1 + j) / 2.0 : 0;
+        ties += (double) (j - i) * (j - i) * (j - i) - (j - i);
+        i = j;
+    }
+
+    double u = rank_new - n * (n + 1) / 2.0;
+    double mean = n * n / 2.0;
+    double var = n * n / 12.0 * ((total + 1) - ties / (total * (total - 1.0)));
+    if (var <= 0)
+        return 1;
+    return 0.5 * erfc((u - mean - 0.5) / sqrt(var) / M_SQRT2);
+}
+
+/* Run one seed/size/distribution for all suite algorithms */
+static void suite_run(int fd,
+                      uint64_t seed,
+                      uint64_t n,
+                      int dist,
+                      struct suite_case *cases)
+{
+    uint64_t res[4][NR_ALGOS];
+
+    set_param_ul("rng_seed", seed);
+    set_param_ul("dist", dist);
+    set_param("count_moves", "1");
+    lseek(fd, n - 1, SEEK_SET);
+    if (read(fd, res, sizeof(res)) < 0) {
+        perror("sort failed");
+        exit(1);
+    }
+    for (int a = 0; a < NR_ALGOS; a++)
+        cases[a] = (struct suite_case){a, seed, n, res[2][a], res[3][a], dist};
+    set_param("count_moves", "0");
+    for (int r = 0; r < SUITE_RUNS; r++) {
+        run(fd, n, res);
+        for (int a = 0; a < NR_ALGOS; a++)
+            cases[a].t[r] = res[0][a];
+    }
+}
+
+static struct suite_case *suite_find(struct suite_case *base,
+                                     size_t num,
+                                     const struct suite_case *c)
+{
+    for (size_t i = 0; i < num; i++) {
+        if (base[i].algo == c->algo && base[i].seed == c->seed &&
+            base[i].n == c->n && base[i].dist == c->dist)
+            return &base[i];
+    }
+    return NULL;
+}
+
+/* Returns the number of cases read from a file written by suite() */
+static size_t suite_load(const char *path, struct suite_case **cases)
+{
+    size_t num = 0, cap = 0;
+    char line[512], name[32];
+    FILE *f = fopen(path, "r");
+
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    *cases = NULL;
+    if (!fgets(line, sizeof(line), f) ||
+        strncmp(line, "# " SUITE_VERSION "\n", sizeof(line))) {
+        fprintf(stderr, "%s: not a " SUITE_VERSION " file, rerun with -B\n",
+                path);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), f)) {
+        struct suite_case c;
+        int pos, len;
+
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%31s %lu %lu %d %lu %lu %*u%n", name, &c.seed, &c.n,
+                   &c.dist, &c.cmps, &c.moves, &pos) != 6)
+            continue;
+        for (int r = 0; r < SUITE_RUNS; r++, pos += len)
+            if (sscanf(line + pos, "%lu%n", &c.t[r], &len) != 1)
+                goto skip;
+        for (c.algo = 0; c.algo < NR_ALGOS; c.algo++)
+            if (!strcmp(name, algo_names[c.algo]))
+                break;
+        if (c.algo == NR_ALGOS)
+            continue;
+        if (num == cap) {
+            cap = cap ? 2 * cap : 256;
+            *cases = realloc(*cases, cap * sizeof(**cases));
+        }
+        (*cases)[num++] = c;
+    skip:;
+    }
+    fclose(f);
+    return num;
+}
+
+/*
+ * Run the suite.  With @check, compare against the baseline in @path and
+ * return the number of regressions; otherwise write a new baseline there.
+ */
+static int suite(int fd, const char *path, int check, double threshold)
+{
+    struct suite_case *base = NULL, cases[NR_ALGOS];
+    size_t nbase = check ? suite_load(path, &base) : 0;
+    int failed = 0, compared = 0;
+    FILE *out = NULL;
+
+    if (!check) {
+        out = fopen(path, "w");
+        if (!out) {
+            perror(path);
+            exit(1);
+        }
+        fprintf(out, "# " SUITE_VERSION "\n");
+        fprintf(out, "# algo seed n dist cmps moves median_ns "
+                     "ns_run1..%d\n",
+                SUITE_RUNS);
+    }
+    set_param("elem_size", "8");
+    set_param("repeat", "1");
+    set_param("probe", "0");
+    set_param_ul("algo_mask", SUITE_ALGOS);
+
+    for (size_t s = 0; s < sizeof(suite_seeds) / sizeof(*suite_seeds); s++) {
+        for (size_t z = 0; z < sizeof(suite_sizes) / sizeof(*suite_sizes);
+             z++) {
+            if (suite_sizes[z] > module_max_len())
+                continue;
+            for (int d = 0; d < SUITE_DISTS; d++) {
+                suite_run(fd, suite_seeds[s], suite_sizes[z], d, cases);
+                for (int a = 0; a < NR_ALGOS; a++) {
+                    const struct suite_case *c = &cases[a], *b;
+
+                    if (!(SUITE_ALGOS & 1 << a))
+                        continue;
+                    if (out) {
+                        fprintf(out, "%s %lu %lu %d %lu %lu %lu",
+                                algo_names[a], c->seed, c->n, c->dist,
+                                c->cmps, c->moves, median(c->t));
+                        for (int r = 0; r < SUITE_RUNS; r++)
+                            fprintf(out, " %lu", c->t[r]);
+                        fprintf(out, "\n");
+                        continue;
+                    }
+                    b = suite_find(base, nbase, c);
+                    if (!b) {
+                        printf("NEW   %s seed %lu n %lu dist %d\n",
+                               algo_names[a], c->seed, c->n, c->dist);
+                        continue;
+                    }
+                    compared++;
+                    if (c->cmps != b->cmps || c->moves != b->moves) {
+                        printf("COUNT %s seed %lu n %lu dist %d: "
+                               "cmps %lu -> %lu, moves %lu -> %lu\n",
+                               algo_names[a], c->seed, c->n, c->dist,
+                               b->cmps, c->cmps, b->moves, c->moves);
+                        failed++;
+                    }
+                    double p = mann_whitney_p(b->t, c->t);
+                    uint64_t mb = median(b->t), mc = median(c->t);
+                    if (p < SUITE_ALPHA && mc > mb * (1 + threshold / 100)) {
+                        printf("TIME  %s seed %lu n %lu dist %d: "
+                               "median %lu -> %lu ns (+%.1f%%, p=%.4f)\n",
+                               algo_names[a], c->seed, c->n, c->dist, mb, mc,
+                               100.0 * (mc - mb) / mb, p);
+                        failed++;
+                    }
+                }
+            }
+        }
+    }
+    set_param("rng_seed", "0");
+    set_param("dist", "0");
+    set_param("algo_mask", DEFAULT_ALGOS);
+    if (out) {
+        fclose(out);
+        printf("baseline written to %s\n", path);
+    } else {
+        printf("%d cases compared, %d regressions\n", compared, failed);
+    }
+    free(base);
+    return failed;
+}
 
-int main()
+/*
+ * Key-prefix caching with an expensive comparator: for each size, the
+ * comparator calls and time of introsort and sort_prefix(), and what the
+ * prefixes saved, one line per size in prefix.txt.
+ */
+static void prefix_sweep(int fd, uint64_t max_len, int ppo)
 {
+    FILE *out = fopen("prefix.txt", "w");
+    uint64_t res[4][NR_ALGOS], prev = 0;
+
+    if (!out) {
+        perror("prefix.txt");
+        exit(1);
+    }
+    fprintf(out, "# n cmps_intro cmps_prefix saved%% ns_intro ns_prefix "
+                 "saved%%\n");
+    set_param_ul("algo_mask", 1 << DECIMAL_INTRO | 1 << DECIMAL_PREFIX);
+    for (int k = 0;; k++) {
+        uint64_t n = llround(exp2((double) k / ppo));
+        if (n > max_len)
+            break;
+        if (n == prev)
+            continue;
+        prev = n;
+        lseek(fd, n - 1, SEEK_SET);
+        if (read(fd, res, sizeof(res)) < 0) {
+            perror("sort failed");
+            exit(1);
+        }
+        uint64_t ci = res[2][DECIMAL_INTRO], cp = res[2][DECIMAL_PREFIX];
+        uint64_t ti = res[0][DECIMAL_INTRO], tp = res[0][DECIMAL_PREFIX];
+        fprintf(out, "%lu %lu %lu %.1f %lu %lu %.1f\n", n, ci, cp,
+                ci ? 100.0 * ((double) ci - cp) / ci : 0, ti, tp,
+                ti ? 100.0 * ((double) ti - tp) / ti : 0);
+    }
+    set_param("algo_mask", DEFAULT_ALGOS);
+    fclose(out);
+}
+
+#define JOB_NUM 65536
+#define JOBS_PER_DEPTH 256
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Async job throughput: for 1..max_depth jobs in flight, push
+ * JOBS_PER_DEPTH introsort jobs of num random u64 through the device,
+ * refilling each buffer as soon as its job is reaped, and write the jobs
+ * per second to jobs.txt.
+ */
+static void job_throughput(int fd, int max_depth, uint64_t num)
+{
+    uint64_t **bufs = calloc(max_depth, sizeof(*bufs));
+    int64_t *slot_id = calloc(max_depth, sizeof(*slot_id));
+    struct sort_job *batch = calloc(max_depth, sizeof(*batch));
+    int *batch_slot = calloc(max_depth, sizeof(*batch_slot));
+    struct sort_result *results = calloc(max_depth, sizeof(*results));
+    FILE *out = fopen("jobs.txt", "w");
+
+    for (int i = 0; i < max_depth; i++)
+        bufs[i] = malloc(num * sizeof(**bufs));
+
+    for (int depth = 1; depth <= max_depth; depth++) {
+        int submitted = 0, done = 0;
+        double start = now();
+
+        for (int i = 0; i < depth; i++)
+            slot_id[i] = -1;
+        while (done < JOBS_PER_DEPTH) {
+            /* prepare a batch for every free slot */
+            struct sort_submit sub = {.jobs = (uintptr_t) batch, .eventfd = -1};
+            for (int i = 0; i < depth && submitted + (int) sub.count <
+                                             JOBS_PER_DEPTH;
+                 i++) {
+                if (slot_id[i] >= 0)
+                    continue;
+                for (uint64_t j = 0; j < num; j++)
+                    bufs[i][j] = (uint64_t) rand() << 32 | rand();
+                batch[sub.count] = (struct sort_job){
+                    .buf = (uintptr_t) bufs[i],
+                    .num = num,
+                    .size = sizeof(**bufs),
+                    .algo = SORT_JOB_INTRO,
+                };
+                batch_slot[sub.count++] = i;
+            }
+            if (sub.count) {
+                if (ioctl(fd, SORT_IOC_SUBMIT, &sub) < 0) {
+                    perror("SORT_IOC_SUBMIT");
+                    exit(1);
+                }
+                for (unsigned int i = 0; i < sub.count; i++)
+                    slot_id[batch_slot[i]] = batch[i].id;
+                submitted += sub.count;
+            }
+
+            struct pollfd pfd = {.fd = fd, .events = POLLIN};
+            if (poll(&pfd, 1, -1) < 0) {
+                perror("poll");
+                exit(1);
+            }
+            struct sort_reap reap = {.results = (uintptr_t) results,
+                                     .max = depth};
+            if (ioctl(fd, SORT_IOC_REAP, &reap) < 0) {
+                perror("SORT_IOC_REAP");
+                exit(1);
+            }
+            for (unsigned int r = 0; r < reap.count; r++) {
+                if (results[r].status)
+                    fprintf(stderr, "job %llu failed: %d\n", results[r].id,
+                            results[r].status);
+                for (int i = 0; i < depth; i++) {
+                    if (slot_id[i] == (int64_t) results[r].id)
+                        slot_id[i] = -1;
+                }
+                done++;
+            }
+        }
+        fprintf(out, "%d %.1f\n", depth, JOBS_PER_DEPTH / (now() - start));
+    }
+
+    fclose(out);
+    for (int i = 0; i < max_depth; i++)
+        free(bufs[i]);
+    free(bufs);
+    free(slot_id);
+    free(batch);
+    free(batch_slot);
+    free(results);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-n max_len] [-p points_per_octave] [-d dist]\n"
+            "          [-r resched_work] [-t resched_ns] [-l]\n"
+            "          [-e elem_size] [-m algo_mask]\n"
+            "       %s -c\n"
+            "       %s -j max_depth [-n job_len]\n"
+            "       %s -s [-n num]\n"
+            "       %s -x [-n max_len] [-p points_per_octave] [-d dist]\n"
+            "       %s -B baseline | -C baseline [-T threshold_pct]\n"
+            "  dist: 0 random, 1 sorted, 2 reversed, 3 few unique, "
+            "4 nearly sorted\n"
+            "  -r, -t: latency-bounded mode, see sort_impl.h\n"
+            "  -l: record worst-case scheduling latency in latency.txt\n"
+            "  -m: bit i runs column i: heap, intro, block, insertion, auto,\n"
+            "      kv intro, kv radix, swap, swap words, list, list gather,\n"
+            "      unique, sort + dedup, intro and prefix with decimal cmp\n"
+            "      (e.g. -m 0x600 -n 10000000 for the list sorts alone,\n"
+            "      -m 0x1800 -d 3 for unique on few unique keys)\n"
+            "  -c: measure the sort_auto crossover table, save it to "
+            CROSSOVER_FILE "\n"
+            "  -j: async job throughput with 1..max_depth jobs in flight, "
+            "to jobs.txt\n"
+            "  -s: swap and sort time by element size, to swap.txt\n"
+            "  -x: comparator calls and time saved by key prefixes, to "
+            "prefix.txt\n"
+            "  -B: run the regression suite and write its baseline\n"
+            "  -C: run it and compare: exact comparison and swap counts,\n"
+            "      times by Mann-Whitney U test (default threshold 5%%)\n",
+            prog, prog, prog, prog, prog, prog);
+    exit(1);
+}
+
+/*
+ * Sizes are swept geometrically from 1 to max_len, so large-N behaviour
+ * can be measured without sorting every size in between.
+ */
+int main(int argc, char *argv[])
+{
+    uint64_t max_len = module_max_len();
+    int ppo = POINTS_PER_OCTAVE;
+    uint64_t res[4][NR_ALGOS]; /* times, latencies, compares, moves */
+    int probe = 0, calib = 0, jobs = 0, swaps = 0, prefix = 0;
+    const char *baseline = NULL;
+    int check = 0;
+    double threshold = SUITE_THRESHOLD;
+    uint64_t job_len = JOB_NUM;
+    ssize_t t;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:p:d:r:t:le:m:cj:sxB:C:T:")) != -1) {
+        switch (opt) {
+        case 'n':
+            max_len = job_len = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            ppo = atoi(optarg);
+            break;
+        case 'd':
+            set_param("dist", optarg);
+            break;
+        case 'r':
+            set_param("resched_work", optarg);
+            break;
+        case 't':
+            set_param("resched_ns", optarg);
+            break;
+        case 'l':
+            probe = 1;
+            break;
+        case 'e':
+            set_param("elem_size", optarg);
+            break;
+        case 'm':
+            set_param("algo_mask", optarg);
+            break;
+        case 'c':
+            calib = 1;
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            break;
+        case 's':
+            swaps = 1;
+            break;
+        case 'x':
+            prefix = 1;
+            break;
+        case 'C':
+            check = 1;
+            /* fall through */
+        case 'B':
+            baseline = optarg;
+            break;
+        case 'T':
+            threshold = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (max_len < 1 || ppo < 1)
+        usage(argv[0]);
+    /* the module clamps larger sizes, which would mislabel the results */
+    if (max_len > module_max_len()) {
+        fprintf(stderr,
+                "-n %lu is above the module's max_len, using %lu; "
+                "reload with e.g. \"make load MODPARAMS=max_len=%lu\"\n",
+                max_len, module_max_len(), max_len);
+        max_len = job_len = module_max_len();
+    }
+    /* jobs above max_len are refused with -EINVAL */
+    if (job_len > module_max_len())
+        job_len = module_max_len();
+    set_param("probe", probe ? "1" : "0");
+
     int fd = open(SORT_DEV, O_RDWR);
-    int t;
-    char buf[1];
     if (fd < 0) {
         perror("Failed to open character device");
         exit(1);
     }
+    if (calib) {
+        calibrate(fd);
+        close(fd);
+        return 0;
+    }
+    if (jobs > 0) {
+        job_throughput(fd, jobs, job_len);
+        close(fd);
+        return 0;
+    }
+    if (baseline) {
+        int failed = suite(fd, baseline, check, threshold);
+        close(fd);
+        return failed ? 2 : 0;
+    }
+    if (prefix) {
+        prefix_sweep(fd, max_len, ppo);
+        close(fd);
+        return 0;
+    }
+    if (swaps) {
+        swap_sweep(fd, max_len < SWAP_NUM ? max_len : SWAP_NUM);
+        close(fd);
+        return 0;
+    }
     FILE *data = fopen("data.txt", "w");
-    for(uint64_t i = 0; i < LEN; i++) {
-        lseek(fd, i, SEEK_SET);
-        t = read(fd, buf, 1);
-        fprintf(data, "%ld %d\n", i + 1, t);
+    FILE *ttest = fopen("ttest.txt", "w");
+    FILE *latency = probe ? fopen("latency.txt", "w") : NULL;
+    FILE *strategy = fopen("auto.txt", "w");
+    uint64_t prev = 0;
+    for (int k = 0;; k++) {
+        uint64_t n = llround(exp2((double) k / ppo));
+        if (n > max_len)
+            break;
+        if (n == prev)
+            continue;
+        prev = n;
+        lseek(fd, n - 1, SEEK_SET);
+        t = read(fd, res, sizeof(res));
+        if (t < 0) {
+            perror("sort failed");
+            break;
+        }
+        fprintf(data, "%lu %lu\n", n, res[2][HEAP]);
+        fprintf(ttest, "%lu", n);
+        for (int i = 0; i < NR_ALGOS; i++)
+            fprintf(ttest, " %lu", res[0][i]);
+        fprintf(ttest, "\n");
+        if (latency) {
+            fprintf(latency, "%lu", n);
+            for (int i = 0; i < NR_ALGOS; i++)
+                fprintf(latency, " %lu", res[1][i]);
+            fprintf(latency, "\n");
+        }
+        long last = get_param("auto_last");
+        if (res[0][AUTO] && last >= 0 &&
+            last < (long) (sizeof(strategy_names) / sizeof(*strategy_names)))
+            fprintf(strategy, "%lu %s\n", n, strategy_names[last]);
     }
     close(fd);
     fclose(data);
+    fclose(ttest);
+    if (latency)
+        fclose(latency);
+    fclose(strategy);
     return 0;
-}
\ No newline at end of file
+}
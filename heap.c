@@ -16,147 +16,8 @@
 #include <linux/types.h>
 
 #include "sort_impl.h"
+#include "swap.h"
 
-/**
- * is_aligned - is this pointer & size okay for word-wide copying?
- * @base: pointer to data
- * @size: size of each element
- * @align: required alignment (typically 4 or 8)
- *
- * Returns true if elements can be copied using word loads and stores.
- * The size must be a multiple of the alignment, and the base address must
- * be if we do not have CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS.
- *
- * For some reason, gcc doesn't know to optimize "if (a & mask || b & mask)"
- * to "if ((a | b) & mask)", so we do that by hand.
- */
-__attribute_const__ __always_inline static bool is_aligned(const void *base,
-                                                           size_t size,
-                                                           unsigned char align)
-{
-    unsigned char lsbits = (unsigned char) size;
-
-    (void) base;
-#ifndef CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS
-    lsbits |= (unsigned char) (uintptr_t) base;
-#endif
-    return (lsbits & (align - 1)) == 0;
-}
-
-/**
- * swap_words_32 - swap two elements in 32-bit chunks
- * @a: pointer to the first element to swap
- * @b: pointer to the second element to swap
- * @n: element size (must be a multiple of 4)
- *
- * Exchange the two objects in memory.  This exploits base+index addressing,
- * which basically all CPUs have, to minimize loop overhead computations.
- *
- * For some reason, on x86 gcc 7.3.0 adds a redundant test of n at the
- * bottom of the loop, even though the zero flag is stil valid from the
- * subtract (since the intervening mov instructions don't alter the flags).
- * Gcc 8.1.0 doesn't have that problem.
- */
-static void swap_words_32(void *_a, void *_b, size_t n)
-{
-    char *a = _a, *b = _b;
-    do {
-        u32 t = *(u32 *) (a + (n -= 4));
-        *(u32 *) (a + n) = *(u32 *) (b + n);
-        *(u32 *) (b + n) = t;
-    } while (n);
-}
-
-/**
- * swap_words_64 - swap two elements in 64-bit chunks
- * @a: pointer to the first element to swap
- * @b: pointer to the second element to swap
- * @n: element size (must be a multiple of 8)
- *
- * Exchange the two objects in memory.  This exploits base+index
- * addressing, which basically all CPUs have, to minimize loop overhead
- * computations.
- *
- * We'd like to use 64-bit loads if possible.  If they're not, emulating
- * one requires base+index+4 addressing which x86 has but most other
- * processors do not.  If CONFIG_64BIT, we definitely have 64-bit loads,
- * but it's possible to have 64-bit loads without 64-bit pointers (e.g.
- * x32 ABI).  Are there any cases the kernel needs to worry about?
- */
-static void swap_words_64(void *_a, void *_b, size_t n)
-{
-    char *a = _a, *b = _b;
-    do {
-#ifdef CONFIG_64BIT
-        u64 t = *(u64 *) (a + (n -= 8));
-        *(u64 *) (a + n) = *(u64 *) (b + n);
-        *(u64 *) (b + n) = t;
-#else
-        /* Use two 32-bit transfers to avoid base+index+4 addressing */
-        u32 t = *(u32 *) (a + (n -= 4));
-        *(u32 *) (a + n) = *(u32 *) (b + n);
-        *(u32 *) (b + n) = t;
-
-        t = *(u32 *) (a + (n -= 4));
-        *(u32 *) (a + n) = *(u32 *) (b + n);
-        *(u32 *) (b + n) = t;
-#endif
-    } while (n);
-}
-
-/**
- * swap_bytes - swap two elements a byte at a time
- * @a: pointer to the first element to swap
- * @b: pointer to the second element to swap
- * @n: element size
- *
- * This is the fallback if alignment doesn't allow using larger chunks.
- */
-static void swap_bytes(void *a, void *b, size_t n)
-{
-    do {
-        char t = ((char *) a)[--n];
-        ((char *) a)[n] = ((char *) b)[n];
-        ((char *) b)[n] = t;
-    } while (n);
-}
-
-/*
- * The values are arbitrary as long as they can't be confused with
- * a pointer, but small integers make for the smallest compare
- * instructions.
- */
-#define SWAP_WORDS_64 (swap_func_t) 0
-#define SWAP_WORDS_32 (swap_func_t) 1
-#define SWAP_BYTES (swap_func_t) 2
-
-/*
- * The function pointer is last to make tail calls most efficient if the
- * compiler decides not to inline this function.
- */
-static void do_swap(void *a, void *b, size_t size, swap_func_t swap_func)
-{
-    if (swap_func == SWAP_WORDS_64)
-        swap_words_64(a, b, size);
-    else if (swap_func == SWAP_WORDS_32)
-        swap_words_32(a, b, size);
-    else if (swap_func == SWAP_BYTES)
-        swap_bytes(a, b, size);
-    else
-        swap_func(a, b, (int) size);
-}
-
-#define _CMP_WRAPPER ((cmp_r_func_t) 0L)
-
-static int do_cmp(const void *a,
-                  const void *b,
-                  cmp_r_func_t cmp,
-                  const void *priv)
-{
-    if (cmp == _CMP_WRAPPER)
-        return ((cmp_func_t)(priv))(a, b);
-    return cmp(a, b, priv);
-}
 
 /**
  * parent - given the offset of the child, find the offset of the parent.
@@ -212,6 +73,7 @@ static void sort_r(void *_base,
                    const void *priv)
 {
     char *base = _base;
+    struct sort_resched rs;
 
     /* pre-scale counters for performance */
     size_t n = num * size, a = (num / 2) * size;
@@ -221,14 +83,10 @@ static void sort_r(void *_base,
     if (!a) /* num < 2 || size == 0 */
         return;
 
-    if (!swap_func) {
-        if (is_aligned(base, size, 8))
-            swap_func = SWAP_WORDS_64;
-        else if (is_aligned(base, size, 4))
-            swap_func = SWAP_WORDS_32;
-        else
-            swap_func = SWAP_BYTES;
-    }
+    if (!swap_func)
+        swap_func = select_swap(base, size);
+
+    sort_resched_init(&rs);
 
     /*
      * Loop invariants:
@@ -272,6 +130,9 @@ static void sort_r(void *_base,
             b = parent(b, lsbit, size);
             do_swap(base + b, base + c, size, swap_func);
         }
+
+        /* Nothing is held between sift rounds: a safe point to yield */
+        sort_resched_point(&rs);
     }
 }
 
@@ -10,6 +10,7 @@
 #include <linux/types.h>
 
 #include "sort_impl.h"
+#include "swap.h"
 
 typedef int (*cmp_func_t)(const void *, const void *);
 
@@ -25,125 +26,36 @@ static inline int __log2(size_t x)
     return 63 - __builtin_clzll(x);
 }
 
-/**
- * swap_words_32 - swap two elements in 32-bit chunks
- * @a: pointer to the first element to swap
- * @b: pointer to the second element to swap
- * @n: element size (must be a multiple of 4)
- *
- * Exchange the two objects in memory.  This exploits base+index addressing,
- * which basically all CPUs have, to minimize loop overhead computations.
- *
- * For some reason, on x86 gcc 7.3.0 adds a redundant test of n at the
- * bottom of the loop, even though the zero flag is stil valid from the
- * subtract (since the intervening mov instructions don't alter the flags).
- * Gcc 8.1.0 doesn't have that problem.
- */
-static void swap_words_32(void *_a, void *_b, size_t n)
-{
-    char *a = _a, *b = _b;
-    do {
-        u32 t = *(u32 *) (a + (n -= 4));
-        *(u32 *) (a + n) = *(u32 *) (b + n);
-        *(u32 *) (b + n) = t;
-    } while (n);
-}
-
-/**
- * swap_words_64 - swap two elements in 64-bit chunks
- * @a: pointer to the first element to swap
- * @b: pointer to the second element to swap
- * @n: element size (must be a multiple of 8)
- *
- * Exchange the two objects in memory.  This exploits base+index
- * addressing, which basically all CPUs have, to minimize loop overhead
- * computations.
- *
- * We'd like to use 64-bit loads if possible.  If they're not, emulating
- * one requires base+index+4 addressing which x86 has but most other
- * processors do not.  If CONFIG_64BIT, we definitely have 64-bit loads,
- * but it's possible to have 64-bit loads without 64-bit pointers (e.g.
- * x32 ABI).  Are there any cases the kernel needs to worry about?
- */
-static void swap_words_64(void *_a, void *_b, size_t n)
-{
-    char *a = _a, *b = _b;
-    do {
-#ifdef CONFIG_64BIT
-        u64 t = *(u64 *) (a + (n -= 8));
-        *(u64 *) (a + n) = *(u64 *) (b + n);
-        *(u64 *) (b + n) = t;
-#else
-        /* Use two 32-bit transfers to avoid base+index+4 addressing */
-        u32 t = *(u32 *) (a + (n -= 4));
-        *(u32 *) (a + n) = *(u32 *) (b + n);
-        *(u32 *) (b + n) = t;
-
-        t = *(u32 *) (a + (n -= 4));
-        *(u32 *) (a + n) = *(u32 *) (b + n);
-        *(u32 *) (b + n) = t;
-#endif
-    } while (n);
-}
-
-/**
- * swap_bytes - swap two elements a byte at a time
- * @a: pointer to the first element to swap
- * @b: pointer to the second element to swap
- * @n: element size
- *
- * This is the fallback if alignment doesn't allow using larger chunks.
- */
-static void swap_bytes(void *a, void *b, size_t n)
-{
-    do {
-        char t = ((char *) a)[--n];
-        ((char *) a)[n] = ((char *) b)[n];
-        ((char *) b)[n] = t;
-    } while (n);
-}
-
 /*
- * The values are arbitrary as long as they can't be confused with
- * a pointer, but small integers make for the smallest compare
- * instructions.
+ * The sort behind all entry points.  With @collapse, the final insertion
+ * pass also merges each element that compares equal to one already placed
+ * into it (through @reduce, if set) instead of inserting it.  Returns the
+ * number of elements left at the front of the array.
  */
-#define SWAP_WORDS_64 (swap_func_t) 0
-#define SWAP_WORDS_32 (swap_func_t) 1
-#define SWAP_BYTES (swap_func_t) 2
-
-/*
- * The function pointer is last to make tail calls most efficient if the
- * compiler decides not to inline this function.
- */
-static void do_swap(void *a, void *b, size_t size, swap_func_t swap_func)
-{
-    if (swap_func == SWAP_WORDS_64)
-        swap_words_64(a, b, size);
-    else if (swap_func == SWAP_WORDS_32)
-        swap_words_32(a, b, size);
-    else if (swap_func == SWAP_BYTES)
-        swap_bytes(a, b, size);
-    else
-        swap_func(a, b, (int) size);
-}
-
-void sort_intro(void *base,
-                size_t num,
-                size_t size,
-                cmp_func_t cmp_func,
-                swap_func_t swap_func)
+static size_t intro_r(void *base,
+                      size_t num,
+                      size_t size,
+                      cmp_r_func_t cmp_func,
+                      swap_func_t swap_func,
+                      const void *priv,
+                      bool collapse,
+                      sort_reduce_func_t reduce)
 {
     if (num == 0)
-        return;
+        return 0;
 
     char *array = (char *) base;
     const size_t max_thresh = size << 4;
     const int max_depth = __log2(num) << 1;
+    struct sort_resched rs;
 
     /* Temporary storage used by both heapsort and shellsort */
     char *tmp = kmalloc(size, GFP_KERNEL);
 
+    if (!swap_func)
+        swap_func = select_swap(base, size);
+    sort_resched_init(&rs);
+
     if (num > 16) {
         char *low = array, *high = array + idx(num - 1);
         stack_node_t *stack =
@@ -152,6 +64,9 @@ void sort_intro(void *base,
 
         int depth = 0;
         while (stack < top) {
+            /* Between partitions: a safe point to yield */
+            sort_resched_point(&rs);
+
             /* Exceeded max depth: do heapsort on this partition */
             if (depth > max_depth) {
                 size_t part_length = (size_t)((high - low) / size) - 1;
@@ -166,9 +81,9 @@ void sort_intro(void *base,
 
                         while (j <= part_length) {
                             if (j < part_length)
-                                j += (cmp_func(low + idx(j), low + idx(j + 1)) <
-                                      0);
-                            if (cmp_func(low + idx(j), tmp) <= 0)
+                                j += (do_cmp(low + idx(j), low + idx(j + 1),
+                                             cmp_func, priv) < 0);
+                            if (do_cmp(low + idx(j), tmp, cmp_func, priv) <= 0)
                                 break;
                             memcpy(low + idx(i), low + idx(j), size);
                             i = j;
@@ -189,8 +104,8 @@ void sort_intro(void *base,
                          */
                         while (j < part_length) {
                             if (j < part_length - 1)
-                                j += (cmp_func(low + idx(j), low + idx(j + 1)) <
-                                      0);
+                                j += (do_cmp(low + idx(j), low + idx(j + 1),
+                                             cmp_func, priv) < 0);
                             memcpy(low + idx(i), low + idx(j), size);
                             i = j;
                             j = (i << 1) + 2;
@@ -201,13 +116,14 @@ void sort_intro(void *base,
                          */
                         while (i > 1) {
                             j = (i - 2) >> 1;
-                            if (cmp_func(tmp, low + idx(j)) <= 0)
+                            if (do_cmp(tmp, low + idx(j), cmp_func, priv) <= 0)
                                 break;
                             memcpy(low + idx(i), low + idx(j), size);
                             i = j;
                         }
 
                         memcpy(low + idx(i), tmp, size);
+                        sort_resched_point(&rs);
                     } while (part_length-- > 0);
                 }
 
@@ -221,27 +137,46 @@ void sort_intro(void *base,
 
             /* 3-way "Dutch national flag" partition */
             char *mid = low + size * ((high - low) / size >> 1);
-            if (cmp_func(mid, low) < 0)
-                do_swap(mid, low, size, 0);
-            if (cmp_func(mid, high) > 0)
-                do_swap(mid, high, size, 0);
+            if (do_cmp(mid, low, cmp_func, priv) < 0)
+                do_swap(mid, low, size, swap_func);
+            if (do_cmp(mid, high, cmp_func, priv) > 0)
+                do_swap(mid, high, size, swap_func);
             else
                 goto skip;
-            if (cmp_func(mid, low) < 0)
-                do_swap(mid, low, size, 0);
+            if (do_cmp(mid, low, cmp_func, priv) < 0)
+                do_swap(mid, low, size, swap_func);
 
         skip:;
+            /* Collapsing: a partition of equal elements needs no sorting,
+             * the final pass folds it in one compare per element.  Only
+             * look when low == mid == high, so other inputs pay a compare
+             * per partition.
+             */
+            if (collapse && do_cmp(low, high, cmp_func, priv) == 0) {
+                char *p = low + size;
+
+                while (p < high && do_cmp(p, low, cmp_func, priv) == 0)
+                    p += size;
+                if (p == high) {
+                    --top;
+                    --depth;
+                    low = top->low;
+                    high = top->high;
+                    continue;
+                }
+            }
+
             char *left = low + size, *right = high - size;
 
             /* sort this partition */
             do {
-                while (cmp_func(left, mid) < 0)
+                while (do_cmp(left, mid, cmp_func, priv) < 0)
                     left += size;
-                while (cmp_func(mid, right) < 0)
+                while (do_cmp(mid, right, cmp_func, priv) < 0)
                     right -= size;
 
                 if (left < right) {
-                    do_swap(left, right, size, 0);
+                    do_swap(left, right, size, swap_func);
                     if (mid == left)
                         mid = right;
                     else if (mid == right)
@@ -251,6 +186,8 @@ void sort_intro(void *base,
                     left += size, right -= size;
                     break;
                 }
+                /* The first partitions are O(n): yield inside them, too */
+                sort_resched_point(&rs);
             } while (left <= right);
 
             /* Prepare the next iteration
@@ -292,6 +229,39 @@ void sort_intro(void *base,
         kfree(stack);
     }
 
+    if (collapse) {
+        /* Insertion sort into [0, w), the sorted and collapsed prefix.  The
+         * compare that ends the scan tells whether there's an equal key, so
+         * this costs no more compares than plain insertion sort, and a
+         * duplicate costs no swaps at all.
+         */
+        size_t w = 1;
+
+        for (size_t j = 1; j < num; j++) {
+            char *x = array + idx(j);
+            size_t k = w;
+            int c;
+
+            while ((c = do_cmp(array + idx(k - 1), x, cmp_func, priv)) > 0 &&
+                   --k > 0)
+                ;
+            if (c == 0) {
+                if (reduce)
+                    reduce(array + idx(k - 1), x);
+            } else {
+                if (w != j)
+                    do_swap(array + idx(w), x, size, swap_func);
+                for (size_t m = w; m > k; m--)
+                    do_swap(array + idx(m - 1), array + idx(m), size,
+                            swap_func);
+                w++;
+            }
+            sort_resched_point(&rs);
+        }
+        kfree(tmp);
+        return w;
+    }
+
     /* Clean up the leftovers with shellsort.
      * Already mostly sorted; use only small gaps.
      */
@@ -299,21 +269,97 @@ void sort_intro(void *base,
 
     int i = 0;
     do {
-        if (num < 4)
-            continue;
-
         for (size_t j = gaps[i], k = j; j < num; k = ++j) {
             // memcpy(tmp, array + idx(k), size);
 
             while (k >= gaps[i] &&
-                   cmp_func(array + idx(k - gaps[i]), array + idx(k)) > 0) {
+                   do_cmp(array + idx(k - gaps[i]), array + idx(k), cmp_func,
+                          priv) > 0) {
                 // memcpy(array + idx(k), array + idx(k - gaps[i]), size);
-                do_swap(array + idx(k), array + idx(k - gaps[i]), size, 0);
+                do_swap(array + idx(k), array + idx(k - gaps[i]), size, swap_func);
                 k -= gaps[i];
             }
+            sort_resched_point(&rs);
 
             // memcpy(array + idx(k), tmp, size);
         }
     } while (i-- > 0);
     kfree(tmp);
-}
\ No newline at end of file
+    return num;
+}
+
+/**
+ * sort_intro_r - introsort an array of elements
+ * @base: pointer to data to sort
+ * @num: number of elements
+ * @size: size of each element
+ * @cmp_func: pointer to comparison function
+ * @swap_func: pointer to swap function or NULL
+ * @priv: third argument passed to comparison function
+ *
+ * Like sort_intro(), for comparisons that need context.
+ */
+void sort_intro_r(void *base,
+                  size_t num,
+                  size_t size,
+                  cmp_r_func_t cmp_func,
+                  swap_func_t swap_func,
+                  const void *priv)
+{
+    intro_r(base, num, size, cmp_func, swap_func, priv, false, NULL);
+}
+
+void sort_intro(void *base,
+                size_t num,
+                size_t size,
+                cmp_func_t cmp_func,
+                swap_func_t swap_func)
+{
+    sort_intro_r(base, num, size, _CMP_WRAPPER, swap_func, cmp_func);
+}
+
+/**
+ * sort_unique - sort an array and drop duplicates
+ * @base: pointer to data to sort
+ * @num: number of elements
+ * @size: size of each element
+ * @cmp_func: pointer to comparison function
+ * @swap_func: pointer to swap function or NULL
+ *
+ * Introsort whose final pass keeps one element of each run of equal ones,
+ * which one is unspecified.  Returns the number of elements kept, sorted at
+ * the front of the array; the contents of the rest are unspecified.
+ */
+size_t sort_unique(void *base,
+                   size_t num,
+                   size_t size,
+                   cmp_func_t cmp_func,
+                   swap_func_t swap_func)
+{
+    return intro_r(base, num, size, _CMP_WRAPPER, swap_func, cmp_func, true,
+                   NULL);
+}
+
+/**
+ * sort_reduce - sort an array and fold duplicates together
+ * @base: pointer to data to sort
+ * @num: number of elements
+ * @size: size of each element
+ * @cmp_func: pointer to comparison function
+ * @swap_func: pointer to swap function or NULL
+ * @reduce: called as reduce(kept, dup) for every element dropped
+ *
+ * Like sort_unique(), but each dropped element is first folded into the one
+ * kept for its key, e.g. to sum or count the values per key.  The order in
+ * which duplicates are folded is unspecified.
+ */
+size_t sort_reduce(void *base,
+                   size_t num,
+                   size_t size,
+                   cmp_func_t cmp_func,
+                   swap_func_t swap_func,
+                   sort_reduce_func_t reduce)
+{
+    return intro_r(base, num, size, _CMP_WRAPPER, swap_func, cmp_func, true,
+                   reduce);
+}
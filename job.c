@@ -0,0 +1,315 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Asynchronous sort jobs, see sort_ioctl.h for the interface.
+ *
+ * Each open file has its own job accounting.  Jobs run on an unbound
+ * workqueue, wherever the scheduler puts its workers, with up to its
+ * default max_active (WQ_DFL_ACTIVE, 256) sorting concurrently, and are
+ * moved to the file's done list when finished.  Sorted data is copied back by
+ * SORT_IOC_REAP, in the submitter's context.
+ */
+
+#include <linux/eventfd.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <asm/unaligned.h>
+
+#include "sort_impl.h"
+#include "sort_ioctl.h"
+
+extern unsigned long max_len;
+
+struct sort_file {
+    spinlock_t lock;
+    struct list_head done; /* finished, not yet reaped */
+    wait_queue_head_t wait;
+    unsigned int inflight; /* submitted, not yet reaped */
+    unsigned int running;  /* submitted, not yet finished */
+    u64 next_id;
+};
+
+struct sort_kjob {
+    struct work_struct work;
+    struct list_head node;
+    struct sort_file *sf;
+    struct eventfd_ctx *efd;
+    void *data;
+    void __user *ubuf;
+    size_t num, size;
+    unsigned int algo;
+    u64 id, ns;
+};
+
+static struct workqueue_struct *sort_wq;
+
+static void (*const job_algos[NR_SORT_JOB_ALGOS])(void *base,
+                                                  size_t num,
+                                                  size_t size,
+                                                  cmp_func_t cmp_func,
+                                                  swap_func_t swap_func) = {
+    [SORT_JOB_HEAP] = sort_heap,
+    [SORT_JOB_INTRO] = sort_intro,
+    [SORT_JOB_BLOCK] = sort_block,
+    [SORT_JOB_INSERTION] = sort_insertion,
+    [SORT_JOB_AUTO] = sort_auto,
+};
+
+/* Jobs run concurrently, so unlike the benchmark this doesn't count */
+static int cmp_key(const void *a, const void *b)
+{
+    u64 a_val = get_unaligned((const u64 *) a);
+    u64 b_val = get_unaligned((const u64 *) b);
+
+    if (a_val > b_val)
+        return 1;
+    if (a_val == b_val)
+        return 0;
+    return -1;
+}
+
+static void sort_kjob_free(struct sort_kjob *job)
+{
+    if (job->efd)
+        eventfd_ctx_put(job->efd);
+    kvfree(job->data);
+    kfree(job);
+}
+
+static void sort_job_work(struct work_struct *work)
+{
+    struct sort_kjob *job = container_of(work, struct sort_kjob, work);
+    struct sort_file *sf = job->sf;
+    ktime_t kt = ktime_get();
+
+    job_algos[job->algo](job->data, job->num, job->size, cmp_key, NULL);
+    job->ns = ktime_to_ns(ktime_sub(ktime_get(), kt));
+
+    /*
+     * Notify under the lock: the job can't be reaped (and freed) before
+     * both signals are out, and once sort_job_release() has seen running
+     * drop to zero and taken the lock, no worker touches sf again.
+     */
+    spin_lock(&sf->lock);
+    list_add_tail(&job->node, &sf->done);
+    sf->running--;
+    if (job->efd)
+        eventfd_signal(job->efd, 1);
+    wake_up(&sf->wait);
+    spin_unlock(&sf->lock);
+}
+
+/* Copy in and queue one job; returns its id through @uid */
+static int sort_job_queue(struct sort_file *sf,
+                          const struct sort_job *uj,
+                          __u64 __user *uid,
+                          int eventfd)
+{
+    struct sort_kjob *job;
+    int rc;
+
+    if (!uj->num || uj->num > max_len || uj->size < sizeof(u64) ||
+        uj->size > SORT_JOB_MAX_SIZE || uj->algo >= NR_SORT_JOB_ALGOS)
+        return -EINVAL;
+    /* jobs run with no resched points; keep the O(n^2) sort short */
+    if (uj->algo == SORT_JOB_INSERTION && uj->num > SORT_JOB_MAX_INSERTION)
+        return -EINVAL;
+    /* no more memory than a benchmark run of max_len u64 */
+    if (uj->num * uj->size > max_len * sizeof(u64))
+        return -E2BIG;
+
+    job = kzalloc(sizeof(*job), GFP_KERNEL);
+    if (!job)
+        return -ENOMEM;
+    job->sf = sf;
+    job->ubuf = u64_to_user_ptr(uj->buf);
+    job->num = uj->num;
+    job->size = uj->size;
+    job->algo = uj->algo;
+    INIT_WORK(&job->work, sort_job_work);
+
+    job->data =
+        kvmalloc_array(job->num, job->size, GFP_KERNEL | __GFP_NOWARN);
+    if (!job->data) {
+        rc = -ENOMEM;
+        goto failed;
+    }
+    if (copy_from_user(job->data, job->ubuf, job->num * job->size)) {
+        rc = -EFAULT;
+        goto failed;
+    }
+    if (eventfd >= 0) {
+        job->efd = eventfd_ctx_fdget(eventfd);
+        if (IS_ERR(job->efd)) {
+            rc = PTR_ERR(job->efd);
+            job->efd = NULL;
+            goto failed;
+        }
+    }
+
+    spin_lock(&sf->lock);
+    if (sf->inflight >= SORT_JOB_MAX_INFLIGHT) {
+        spin_unlock(&sf->lock);
+        rc = -EAGAIN;
+        goto failed;
+    }
+    sf->inflight++;
+    sf->running++;
+    job->id = sf->next_id++;
+    spin_unlock(&sf->lock);
+
+    if (put_user(job->id, uid)) {
+        spin_lock(&sf->lock);
+        sf->inflight--;
+        sf->running--;
+        spin_unlock(&sf->lock);
+        rc = -EFAULT;
+        goto failed;
+    }
+    queue_work(sort_wq, &job->work);
+    return 0;
+
+failed:
+    sort_kjob_free(job);
+    return rc;
+}
+
+/*
+ * Queue jobs until the batch is done or one fails.  If at least one was
+ * queued, returns 0 and the number queued in count; otherwise the error.
+ */
+static long sort_job_submit(struct sort_file *sf,
+                            struct sort_submit __user *usub)
+{
+    struct sort_submit sub;
+    struct sort_job __user *ujobs;
+    struct sort_job uj;
+    __u32 i;
+    int rc = 0;
+
+    if (copy_from_user(&sub, usub, sizeof(sub)))
+        return -EFAULT;
+    ujobs = u64_to_user_ptr(sub.jobs);
+    for (i = 0; i < sub.count; i++) {
+        if (copy_from_user(&uj, &ujobs[i], sizeof(uj))) {
+            rc = -EFAULT;
+            break;
+        }
+        rc = sort_job_queue(sf, &uj, &ujobs[i].id, sub.eventfd);
+        if (rc < 0)
+            break;
+    }
+    if (put_user(i, &usub->count))
+        return -EFAULT;
+    return i ? 0 : rc;
+}
+
+/* Hand back up to max finished jobs, never blocking */
+static long sort_job_reap(struct sort_file *sf, struct sort_reap __user *ureap)
+{
+    struct sort_reap reap;
+    struct sort_result __user *ures;
+    struct sort_result res;
+    struct sort_kjob *job;
+    __u32 n = 0;
+    int rc = 0;
+
+    if (copy_from_user(&reap, ureap, sizeof(reap)))
+        return -EFAULT;
+    ures = u64_to_user_ptr(reap.results);
+    while (n < reap.max) {
+        spin_lock(&sf->lock);
+        job = list_first_entry_or_null(&sf->done, struct sort_kjob, node);
+        if (job) {
+            list_del(&job->node);
+            sf->inflight--;
+        }
+        spin_unlock(&sf->lock);
+        if (!job)
+            break;
+
+        memset(&res, 0, sizeof(res));
+        res.id = job->id;
+        res.ns = job->ns;
+        if (copy_to_user(job->ubuf, job->data, job->num * job->size))
+            res.status = -EFAULT;
+        sort_kjob_free(job);
+        if (copy_to_user(&ures[n], &res, sizeof(res))) {
+            rc = -EFAULT;
+            break;
+        }
+        n++;
+    }
+    if (put_user(n, &ureap->count))
+        return -EFAULT;
+    return rc;
+}
+
+long sort_job_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct sort_file *sf = file->private_data;
+
+    switch (cmd) {
+    case SORT_IOC_SUBMIT:
+        return sort_job_submit(sf, (struct sort_submit __user *) arg);
+    case SORT_IOC_REAP:
+        return sort_job_reap(sf, (struct sort_reap __user *) arg);
+    default:
+        return -ENOTTY;
+    }
+}
+
+__poll_t sort_job_poll(struct file *file, poll_table *wait)
+{
+    struct sort_file *sf = file->private_data;
+    __poll_t mask = 0;
+
+    poll_wait(file, &sf->wait, wait);
+    spin_lock(&sf->lock);
+    if (!list_empty(&sf->done))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    spin_unlock(&sf->lock);
+    return mask;
+}
+
+int sort_job_open(struct inode *inode, struct file *file)
+{
+    struct sort_file *sf = kzalloc(sizeof(*sf), GFP_KERNEL);
+
+    if (!sf)
+        return -ENOMEM;
+    spin_lock_init(&sf->lock);
+    INIT_LIST_HEAD(&sf->done);
+    init_waitqueue_head(&sf->wait);
+    file->private_data = sf;
+    return 0;
+}
+
+int sort_job_release(struct inode *inode, struct file *file)
+{
+    struct sort_file *sf = file->private_data;
+    struct sort_kjob *job, *tmp;
+
+    /* Jobs can't be cancelled once queued; wait for them */
+    wait_event(sf->wait, !READ_ONCE(sf->running));
+    spin_lock(&sf->lock);
+    spin_unlock(&sf->lock);
+
+    list_for_each_entry_safe (job, tmp, &sf->done, node)
+        sort_kjob_free(job);
+    kfree(sf);
+    return 0;
+}
+
+int sort_job_init(void)
+{
+    sort_wq = alloc_workqueue("sort_jobs", WQ_UNBOUND, 0);
+    return sort_wq ? 0 : -ENOMEM;
+}
+
+void sort_job_exit(void)
+{
+    destroy_workqueue(sort_wq);
+}
@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Key/value sorts over separate (SoA) key and payload arrays
+ *
+ * The keys are u64 and compared inline.  Every payload array is permuted in
+ * lockstep with the keys.  How each payload is swapped is decided once per
+ * call from its base and element size with select_swap(), so moving an
+ * element costs a few compares in the inlined do_swap() instead of an
+ * indirect swap_func call per array.
+ *
+ * sort_kv_intro() is an introsort: quicksort on the keys, heapsort once the
+ * recursion gets too deep, insertion sort for small partitions.
+ * sort_kv_radix() is an in-place MSD radix sort ("American flag sort"), one
+ * byte per pass, starting at the highest byte in which the keys differ.
+ * Neither is stable.
+ */
+
+#include <linux/errno.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+#include <linux/types.h>
+
+#include "sort_impl.h"
+#include "swap.h"
+
+struct kv_array {
+    char *base;
+    size_t size;
+    swap_func_t swap;
+};
+
+struct kv {
+    u64 *keys;
+    unsigned int npayloads;
+    struct kv_array p[SORT_KV_MAX_PAYLOADS];
+};
+
+#define KV_INSERTION_MAX 16
+
+static int kv_init(struct kv *kv,
+                   u64 *keys,
+                   const struct sort_kv_payload *payloads,
+                   size_t npayloads)
+{
+    if (npayloads > SORT_KV_MAX_PAYLOADS)
+        return -EINVAL;
+
+    kv->keys = keys;
+    kv->npayloads = npayloads;
+    for (size_t i = 0; i < npayloads; i++) {
+        struct kv_array *a = &kv->p[i];
+
+        a->base = payloads[i].base;
+        a->size = payloads[i].size;
+        if (!a->size)
+            return -EINVAL;
+        a->swap = select_swap(a->base, a->size);
+    }
+    return 0;
+}
+
+/* Swap element i and j of the keys and of every payload */
+static __always_inline void kv_swap(const struct kv *kv, size_t i, size_t j)
+{
+    u64 t = kv->keys[i];
+
+    kv->keys[i] = kv->keys[j];
+    kv->keys[j] = t;
+
+    for (unsigned int n = 0; n < kv->npayloads; n++) {
+        const struct kv_array *a = &kv->p[n];
+
+        do_swap(a->base + i * a->size, a->base + j * a->size, a->size,
+                a->swap);
+    }
+}
+
+static void kv_insertion_sort(const struct kv *kv, size_t lo, size_t hi)
+{
+    for (size_t i = lo + 1; i < hi; i++) {
+        for (size_t j = i; j > lo && kv->keys[j - 1] > kv->keys[j]; j--)
+            kv_swap(kv, j - 1, j);
+    }
+}
+
+static void kv_heapsort(const struct kv *kv, size_t lo, size_t hi)
+{
+    size_t n = hi - lo, i, c;
+    const u64 *k = kv->keys + lo;
+
+    for (size_t a = n / 2; a-- > 0;) {
+        for (i = a; (c = 2 * i + 1) < n; i = c) {
+            if (c + 1 < n && k[c] < k[c + 1])
+                c++;
+            if (k[i] >= k[c])
+                break;
+            kv_swap(kv, lo + i, lo + c);
+        }
+    }
+    while (--n > 0) {
+        kv_swap(kv, lo, lo + n);
+        for (i = 0; (c = 2 * i + 1) < n; i = c) {
+            if (c + 1 < n && k[c] < k[c + 1])
+                c++;
+            if (k[i] >= k[c])
+                break;
+            kv_swap(kv, lo + i, lo + c);
+        }
+    }
+}
+
+/* Quicksort [lo, hi), recursing into the smaller side only */
+static void kv_introsort(const struct kv *kv, size_t lo, size_t hi, int depth)
+{
+    const u64 *k = kv->keys;
+
+    while (hi - lo > KV_INSERTION_MAX) {
+        size_t mid = lo + (hi - lo) / 2, i, j;
+        u64 pivot;
+
+        if (depth-- == 0) {
+            kv_heapsort(kv, lo, hi);
+            return;
+        }
+
+        /* median of three to lo, then Hoare partition around it */
+        if (k[mid] < k[lo])
+            kv_swap(kv, mid, lo);
+        if (k[hi - 1] < k[mid]) {
+            kv_swap(kv, hi - 1, mid);
+            if (k[mid] < k[lo])
+                kv_swap(kv, mid, lo);
+        }
+        kv_swap(kv, lo, mid);
+        pivot = k[lo];
+
+        i = lo;
+        j = hi;
+        for (;;) {
+            do
+                i++;
+            while (k[i] < pivot);
+            do
+                j--;
+            while (pivot < k[j]);
+            if (i >= j)
+                break;
+            kv_swap(kv, i, j);
+        }
+        kv_swap(kv, lo, j);
+
+        /* [lo, j) <= pivot == k[j] <= [j + 1, hi) */
+        if (j - lo < hi - j - 1) {
+            kv_introsort(kv, lo, j, depth);
+            lo = j + 1;
+        } else {
+            kv_introsort(kv, j + 1, hi, depth);
+            hi = j;
+        }
+    }
+    kv_insertion_sort(kv, lo, hi);
+}
+
+/**
+ * sort_kv_intro - introsort u64 keys, moving payloads along
+ * @keys: the keys to sort
+ * @num: number of keys, and of elements in each payload array
+ * @payloads: payload arrays to permute in lockstep with @keys
+ * @npayloads: number of payload arrays, at most SORT_KV_MAX_PAYLOADS
+ *
+ * Returns 0, or -EINVAL if a payload is malformed or there are too many.
+ */
+int sort_kv_intro(u64 *keys,
+                  size_t num,
+                  const struct sort_kv_payload *payloads,
+                  size_t npayloads)
+{
+    struct kv kv;
+    int rc = kv_init(&kv, keys, payloads, npayloads);
+
+    if (rc < 0 || num < 2)
+        return rc;
+    kv_introsort(&kv, 0, num, 2 * ilog2(num));
+    return 0;
+}
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+/* Per-level bucket cursors and ends; the recursion uses one level per byte */
+struct radix_level {
+    size_t next[RADIX_BUCKETS];
+    size_t end[RADIX_BUCKETS];
+};
+
+static void kv_radix(const struct kv *kv,
+                     size_t lo,
+                     size_t hi,
+                     int shift,
+                     struct radix_level *lv)
+{
+    const u64 *k = kv->keys;
+    size_t *next = lv->next, *end = lv->end;
+    unsigned int b, d;
+
+    memset(end, 0, sizeof(lv->end));
+    for (size_t i = lo; i < hi; i++)
+        end[(k[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+    for (b = 0, next[0] = lo; b < RADIX_BUCKETS; b++) {
+        end[b] += next[b];
+        if (b + 1 < RADIX_BUCKETS)
+            next[b + 1] = end[b];
+    }
+
+    /* Cycle every element into its bucket */
+    for (b = 0; b < RADIX_BUCKETS; b++) {
+        while (next[b] < end[b]) {
+            d = (k[next[b]] >> shift) & (RADIX_BUCKETS - 1);
+            if (d == b)
+                next[b]++;
+            else
+                kv_swap(kv, next[b], next[d]++);
+        }
+    }
+
+    if (!shift)
+        return;
+    for (b = 0; b < RADIX_BUCKETS; lo = end[b++]) {
+        if (end[b] - lo <= KV_INSERTION_MAX)
+            kv_insertion_sort(kv, lo, end[b]);
+        else
+            kv_radix(kv, lo, end[b], shift - RADIX_BITS, lv + 1);
+    }
+}
+
+/**
+ * sort_kv_radix - radix sort u64 keys, moving payloads along
+ * @keys: the keys to sort
+ * @num: number of keys, and of elements in each payload array
+ * @payloads: payload arrays to permute in lockstep with @keys
+ * @npayloads: number of payload arrays, at most SORT_KV_MAX_PAYLOADS
+ *
+ * Bytes above the highest bit in which any two keys differ are skipped.
+ * Returns 0, -EINVAL if a payload is malformed or there are too many, or
+ * -ENOMEM if the bucket tables (4K per byte sorted on) can't be allocated.
+ */
+int sort_kv_radix(u64 *keys,
+                  size_t num,
+                  const struct sort_kv_payload *payloads,
+                  size_t npayloads)
+{
+    struct radix_level *levels;
+    u64 all_or = 0, all_and = ~0ULL;
+    int shift, rc;
+    struct kv kv;
+
+    rc = kv_init(&kv, keys, payloads, npayloads);
+    if (rc < 0 || num < 2)
+        return rc;
+    if (num <= KV_INSERTION_MAX) {
+        kv_insertion_sort(&kv, 0, num);
+        return 0;
+    }
+
+    for (size_t i = 0; i < num; i++) {
+        all_or |= keys[i];
+        all_and &= keys[i];
+    }
+    if (all_or == all_and) /* all keys equal */
+        return 0;
+    shift = ilog2(all_or ^ all_and) / RADIX_BITS * RADIX_BITS;
+
+    levels = kvmalloc_array(shift / RADIX_BITS + 1, sizeof(*levels),
+                            GFP_KERNEL);
+    if (!levels)
+        return -ENOMEM;
+    kv_radix(&kv, 0, num, shift, levels);
+    kvfree(levels);
+    return 0;
+}
@@ -0,0 +1,262 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Sorting doubly linked lists
+ *
+ * sort_list() is the bottom-up merge sort of lib/list_sort.c.  It keeps
+ * the merges balanced (2:1 at worst), needs no memory beyond the list and
+ * is stable, with n*log2(n) - 1.2*n comparisons.  But every step follows a
+ * next pointer, so once the nodes are scattered over more memory than the
+ * caches hold, it waits on a cache miss per node per pass.
+ *
+ * sort_list_gather() collects the node pointers into an array, sorts that
+ * with introsort and relinks the list.  The sort moves 8-byte pointers in a
+ * dense array; only the comparisons still touch the nodes.  It needs n
+ * pointers of memory and is not stable.
+ */
+
+#include <linux/list.h>
+#include <linux/prefetch.h>
+#include <linux/slab.h>
+#include <linux/types.h>
+
+#include "sort_impl.h"
+
+/*
+ * Returns a list organized in an intermediate format suited
+ * to chaining of merge() calls: null-terminated, no reserved or
+ * sentinel head node, "prev" links not maintained.
+ */
+static struct list_head *merge(void *priv,
+                               sort_list_cmp_func_t cmp,
+                               struct list_head *a,
+                               struct list_head *b,
+                               struct sort_resched *rs)
+{
+    struct list_head *head, **tail = &head;
+
+    for (;;) {
+        sort_resched_point(rs);
+        /* if equal, take 'a' -- important for sort stability */
+        if (cmp(priv, a, b) <= 0) {
+            *tail = a;
+            tail = &a->next;
+            a = a->next;
+            if (!a) {
+                *tail = b;
+                break;
+            }
+        } else {
+            *tail = b;
+            tail = &b->next;
+            b = b->next;
+            if (!b) {
+                *tail = a;
+                break;
+            }
+        }
+    }
+    return head;
+}
+
+/*
+ * Combine final list merge with restoration of standard doubly-linked
+ * list structure.  This approach duplicates code from merge(), but
+ * runs faster than the tidier alternatives of either a separate final
+ * prev-link restoration pass, or maintaining the prev links
+ * throughout.
+ */
+static void merge_final(void *priv,
+                        sort_list_cmp_func_t cmp,
+                        struct list_head *head,
+                        struct list_head *a,
+                        struct list_head *b,
+                        struct sort_resched *rs)
+{
+    struct list_head *tail = head;
+
+    for (;;) {
+        sort_resched_point(rs);
+        /* if equal, take 'a' -- important for sort stability */
+        if (cmp(priv, a, b) <= 0) {
+            tail->next = a;
+            a->prev = tail;
+            tail = a;
+            a = a->next;
+            if (!a)
+                break;
+        } else {
+            tail->next = b;
+            b->prev = tail;
+            tail = b;
+            b = b->next;
+            if (!b) {
+                b = a;
+                break;
+            }
+        }
+    }
+
+    /* Finish linking remainder of list b on to tail */
+    tail->next = b;
+    do {
+        b->prev = tail;
+        tail = b;
+        b = b->next;
+    } while (b);
+
+    /* And the final links to make a circular doubly-linked list */
+    tail->next = head;
+    head->prev = tail;
+}
+
+/**
+ * sort_list - sort a list
+ * @priv: private data, opaque to sort_list(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: the elements comparison function
+ *
+ * Same interface and algorithm as list_sort(): @cmp returns > 0 to sort
+ * @a after @b, and <= 0 to keep them in their original order.
+ *
+ * The pending sublists are kept in a singly linked list through their
+ * prev pointers.  Whenever the count of nodes seen reaches a point where
+ * two pending sublists of size 2^k would be followed by a third, the two
+ * are merged, so merges are never worse than 2:1 and the 3*2^k elements
+ * involved fit in cache as long as possible.  See lib/list_sort.c for the
+ * full analysis.
+ */
+void sort_list(void *priv, struct list_head *head, sort_list_cmp_func_t cmp)
+{
+    struct list_head *list = head->next, *pending = NULL;
+    size_t count = 0; /* Count of pending */
+    struct sort_resched rs;
+
+    if (list == head->prev) /* Zero or one elements */
+        return;
+
+    sort_resched_init(&rs);
+
+    /* Convert to a null-terminated singly-linked list. */
+    head->prev->next = NULL;
+
+    /*
+     * Data structure invariants:
+     * - All lists are singly linked and null-terminated; prev
+     *   pointers are not maintained.
+     * - pending is a prev-linked "list of lists" of sorted
+     *   sublists awaiting further merging.
+     * - Each of the sorted sublists is power-of-two in size.
+     * - Sublists are sorted by size and age, smallest & newest at front.
+     * - There are zero to two sublists of each size.
+     * - A pair of pending sublists are merged as soon as the number
+     *   of following pending elements equals their size (i.e.
+     *   each time count reaches an odd multiple of that size).
+     *   That ensures each later final merge will be at worst 2:1.
+     * - Each round consists of:
+     *   - Merging the two sublists selected by the highest bit
+     *     which flips when count is incremented, and
+     *   - Adding an element from the input as a size-1 sublist.
+     */
+    do {
+        size_t bits;
+        struct list_head **tail = &pending;
+
+        /* Find the least-significant clear bit in count */
+        for (bits = count; bits & 1; bits >>= 1)
+            tail = &(*tail)->prev;
+        /* Do the indicated merge */
+        if (likely(bits)) {
+            struct list_head *a = *tail, *b = a->prev;
+
+            a = merge(priv, cmp, b, a, &rs);
+            /* Install the merged result in place of the inputs */
+            a->prev = b->prev;
+            *tail = a;
+        }
+
+        /* Move one element from input list to pending */
+        list->prev = pending;
+        pending = list;
+        list = list->next;
+        pending->next = NULL;
+        count++;
+    } while (list);
+
+    /* End of input; merge together all the pending lists. */
+    list = pending;
+    pending = pending->prev;
+    for (;;) {
+        struct list_head *next = pending->prev;
+
+        if (!next)
+            break;
+        list = merge(priv, cmp, pending, list, &rs);
+        pending = next;
+    }
+    /* The final merge, rebuilding prev links */
+    merge_final(priv, cmp, head, pending, list, &rs);
+}
+
+struct list_gather {
+    sort_list_cmp_func_t cmp;
+    void *priv;
+};
+
+static int gather_cmp(const void *a, const void *b, const void *priv)
+{
+    const struct list_gather *g = priv;
+
+    return g->cmp(g->priv, *(const struct list_head *const *) a,
+                  *(const struct list_head *const *) b);
+}
+
+/* How far ahead of the relink to prefetch the nodes */
+#define RELINK_PREFETCH 8
+
+/**
+ * sort_list_gather - sort a list through an array of its nodes
+ * @priv: private data, opaque to sort_list_gather(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: the elements comparison function
+ *
+ * Same interface as sort_list(), but not stable.  Falls back to sort_list()
+ * if the pointer array can't be allocated.
+ */
+void sort_list_gather(void *priv,
+                      struct list_head *head,
+                      sort_list_cmp_func_t cmp)
+{
+    struct list_gather g = {cmp, priv};
+    struct list_head **nodes, *pos, *prev;
+    size_t num = 0, i;
+
+    if (head->next == head->prev) /* Zero or one elements */
+        return;
+
+    list_for_each(pos, head)
+        num++;
+    nodes = kvmalloc_array(num, sizeof(*nodes), GFP_KERNEL);
+    if (!nodes) {
+        sort_list(priv, head, cmp);
+        return;
+    }
+
+    i = 0;
+    list_for_each(pos, head)
+        nodes[i++] = pos;
+
+    sort_intro_r(nodes, num, sizeof(*nodes), gather_cmp, NULL, &g);
+
+    /* The nodes are visited in a new order: fetch them ahead */
+    prev = head;
+    for (i = 0; i < num; i++) {
+        if (i + RELINK_PREFETCH < num)
+            prefetchw(nodes[i + RELINK_PREFETCH]);
+        prev->next = nodes[i];
+        nodes[i]->prev = prev;
+        prev = nodes[i];
+    }
+    prev->next = head;
+    head->prev = prev;
+    kvfree(nodes);
+}
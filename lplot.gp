@@ -0,0 +1,13 @@
+# worst-case scheduling latency on the sorting CPU (client -l)
+reset
+set terminal png
+set title 'scheduling latency'
+set xlabel 'number of data'
+set ylabel 'max latency(ns)'
+set logscale xy
+set output 'latency.png'
+
+plot \
+"latency.txt" using 1:2 with linespoints title 'heap sort' , \
+'' using 1:3 with linespoints title 'intro sort' , \
+'' using 1:4 with linespoints title 'block merge sort'
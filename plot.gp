@@ -2,9 +2,14 @@ reset
 set terminal png
 set title 'performance'
 set xlabel 'number of data'
-set ylabel 'time(us)'
+set ylabel 'time(ns)'
+set logscale xy
 set output 'perform_compare.png'
 
 plot \
-"ttest.txt" using 1:2 with line title 'heap sort' , \
-'' using 1:3 with line title 'intro sort'
\ No newline at end of file
+"ttest.txt" using 1:2 with linespoints title 'heap sort' , \
+'' using 1:3 with linespoints title 'intro sort' , \
+'' using 1:4 with linespoints title 'block merge sort' , \
+'' using 1:6 with linespoints title 'auto' , \
+'' using 1:7 with linespoints title 'kv intro sort' , \
+'' using 1:8 with linespoints title 'kv radix sort'
@@ -4,6 +4,7 @@ set terminal png
 set title 'comparison number'
 set xlabel 'number of data'
 set ylabel 'comparison'
+set logscale x
 set output 'cmp.png'
 
 base(x) = x * log10(x) / log10(2) + 0.37 * x
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Sorting with cached key prefixes
+ *
+ * When cmp_func is expensive (multi-field structs, strings, pointers to
+ * chase), a sort spends its time calling it on the same elements over and
+ * over.  sort_prefix() asks the caller for an order-preserving 64-bit
+ * prefix of each element once, and sorts (prefix, index) pairs with
+ * sort_intro_r().  Those are compared inline with integer compares (see
+ * _CMP_PREFIX), calling cmp_func only when two prefixes are equal.
+ * Finally the elements are permuted into place.
+ *
+ * The encoder must satisfy: prefix(a) < prefix(b) implies cmp(a, b) < 0.
+ * Equal prefixes say nothing, so a constant encoder is correct, just slow.
+ * Not stable.
+ */
+
+#include <linux/errno.h>
+#include <linux/slab.h>
+#include <linux/types.h>
+
+#include "sort_impl.h"
+#include "swap.h"
+
+/**
+ * sort_prefix - sort an array, comparing cached key prefixes first
+ * @base: pointer to data to sort
+ * @num: number of elements
+ * @size: size of each element
+ * @cmp_func: pointer to comparison function
+ * @swap_func: pointer to swap function or NULL
+ * @prefix: order-preserving encoder, called once per element
+ *
+ * Needs 16 bytes per element of temporary memory.  Returns 0, or -ENOMEM
+ * with the array untouched if that can't be allocated.
+ */
+int sort_prefix(void *base,
+                size_t num,
+                size_t size,
+                cmp_func_t cmp_func,
+                swap_func_t swap_func,
+                sort_prefix_func_t prefix)
+{
+    struct sort_prefix_ctx ctx = {.base = base, .size = size, .cmp = cmp_func};
+    struct sort_prefix_ent *ent;
+    char *array = base;
+
+    if (num < 2)
+        return 0;
+    ent = kvmalloc_array(num, sizeof(*ent), GFP_KERNEL);
+    if (!ent)
+        return -ENOMEM;
+    if (!swap_func)
+        swap_func = select_swap(base, size);
+
+    for (size_t i = 0; i < num; i++) {
+        ent[i].prefix = prefix(array + i * size);
+        ent[i].idx = i;
+    }
+    sort_intro_r(ent, num, sizeof(*ent), _CMP_PREFIX, NULL, &ctx);
+
+    /*
+     * Element ent[i].idx belongs at i.  Follow each cycle of the
+     * permutation with swaps, one fewer than its length, marking the
+     * places done by pointing them at themselves.
+     */
+    for (size_t i = 0; i < num; i++) {
+        size_t j = i, k;
+
+        while ((k = ent[j].idx) != i) {
+            do_swap(array + j * size, array + k * size, size, swap_func);
+            ent[j].idx = j;
+            j = k;
+        }
+        ent[j].idx = j;
+    }
+    kvfree(ent);
+    return 0;
+}
@@ -1,11 +1,99 @@
 #ifndef SORT_IMPL_H
 #define SORT_IMPL_H
 
+#include <linux/ktime.h>
+#include <linux/sched.h>
+
 typedef void (*swap_func_t)(void *a, void *b, int size);
 
 typedef int (*cmp_r_func_t)(const void *a, const void *b, const void *priv);
 typedef int (*cmp_func_t)(const void *a, const void *b);
 
+/*
+ * The _r sorts take a cmp_r_func_t and its priv.  The plain entry points
+ * pass _CMP_WRAPPER with their cmp_func_t as priv, so both share one body.
+ */
+#define _CMP_WRAPPER ((cmp_r_func_t) 0L)
+
+/*
+ * sort_prefix() sorts struct sort_prefix_ent and passes _CMP_PREFIX with a
+ * struct sort_prefix_ctx as priv, so the prefix compares are inlined into
+ * the sort and only ties call the element comparator.
+ */
+#define _CMP_PREFIX ((cmp_r_func_t) 1L)
+
+struct sort_prefix_ent {
+    u64 prefix;
+    size_t idx;
+};
+
+struct sort_prefix_ctx {
+    const char *base;
+    size_t size;
+    cmp_func_t cmp;
+};
+
+static inline int prefix_ent_cmp(const struct sort_prefix_ent *a,
+                                 const struct sort_prefix_ent *b,
+                                 const struct sort_prefix_ctx *ctx)
+{
+    /* introsort compares the pivot with itself */
+    if (a == b)
+        return 0;
+    if (a->prefix != b->prefix)
+        return a->prefix < b->prefix ? -1 : 1;
+    return ctx->cmp(ctx->base + a->idx * ctx->size,
+                    ctx->base + b->idx * ctx->size);
+}
+
+static inline int do_cmp(const void *a,
+                         const void *b,
+                         cmp_r_func_t cmp,
+                         const void *priv)
+{
+    if (cmp == _CMP_WRAPPER)
+        return ((cmp_func_t)(priv))(a, b);
+    if (cmp == _CMP_PREFIX)
+        return prefix_ent_cmp(a, b, priv);
+    return cmp(a, b, priv);
+}
+
+/*
+ * Latency-bounded mode.  Sorting millions of elements takes long enough to
+ * trigger soft-lockup warnings on non-preemptible kernels, so the sorts
+ * count work (sift rounds, partition steps) and offer to reschedule at safe
+ * points:
+ * - sort_resched_work == 0: never yield (the default).
+ * - sort_resched_ns == 0: cond_resched() every sort_resched_work units.
+ * - otherwise: every sort_resched_work units read the clock, and
+ *   cond_resched() if sort_resched_ns have passed since the last yield.
+ */
+extern unsigned long sort_resched_work;
+extern unsigned long sort_resched_ns;
+
+struct sort_resched {
+    unsigned long work;
+    u64 last;
+};
+
+static inline void sort_resched_init(struct sort_resched *rs)
+{
+    rs->work = sort_resched_work;
+    rs->last = sort_resched_ns ? ktime_get_ns() : 0;
+}
+
+static inline void sort_resched_point(struct sort_resched *rs)
+{
+    if (likely(!rs->work) || --rs->work)
+        return;
+    rs->work = sort_resched_work;
+    if (sort_resched_ns && ktime_get_ns() - rs->last < sort_resched_ns)
+        return;
+    cond_resched();
+    if (sort_resched_ns)
+        rs->last = ktime_get_ns();
+}
+
 extern void sort_heap(void *base,
                       size_t num,
                       size_t size,
@@ -18,6 +106,122 @@ extern void sort_intro(void *_array,
                        cmp_func_t comparator,
                        swap_func_t swap_func);
 
+extern void sort_intro_r(void *base,
+                         size_t num,
+                         size_t size,
+                         cmp_r_func_t cmp_func,
+                         swap_func_t swap_func,
+                         const void *priv);
+
+/* Folds @src, a duplicate of @dst's key, into @dst */
+typedef void (*sort_reduce_func_t)(void *dst, const void *src);
+
+/* Sort and collapse equal elements; return the new length, see intro.c */
+extern size_t sort_unique(void *base,
+                          size_t num,
+                          size_t size,
+                          cmp_func_t cmp_func,
+                          swap_func_t swap_func);
+
+extern size_t sort_reduce(void *base,
+                          size_t num,
+                          size_t size,
+                          cmp_func_t cmp_func,
+                          swap_func_t swap_func,
+                          sort_reduce_func_t reduce);
+
+/* Order-preserving 64-bit prefix of an element's key, for sort_prefix() */
+typedef u64 (*sort_prefix_func_t)(const void *elem);
+
+/* Sort comparing cached prefixes, cmp_func only on ties; see prefix.c */
+extern int sort_prefix(void *base,
+                       size_t num,
+                       size_t size,
+                       cmp_func_t cmp_func,
+                       swap_func_t swap_func,
+                       sort_prefix_func_t prefix);
+
+/* Stable, in-place block merge sort using O(1) extra memory */
+extern void sort_block(void *base,
+                       size_t num,
+                       size_t size,
+                       cmp_func_t cmp_func,
+                       swap_func_t swap_func);
+
+extern void sort_insertion(void *base,
+                           size_t num,
+                           size_t size,
+                           cmp_func_t cmp_func,
+                           swap_func_t swap_func);
+
+/* Strategies sort_auto() can pick from */
+enum sort_strategy {
+    SORT_INSERTION,
+    SORT_HEAP,
+    SORT_INTRO,
+    NR_SORT_STRATEGIES
+};
+
+/*
+ * Crossover points for sort_auto(), loaded as module parameters.
+ * insertion_max and heap_min_size are measured per machine by the
+ * benchmark; heap_min_size is indexed by whether the elements are
+ * unaligned, i.e. can't be swapped a word at a time.  presorted_pct and
+ * dup_pct describe the input rather than the machine, so "client -c"
+ * leaves them at their fixed defaults (100 and 25).
+ */
+struct sort_auto_table {
+    unsigned long insertion_max;    /* insertion sort up to this many */
+    unsigned long heap_min_size[2]; /* heapsort from this element size */
+    unsigned int presorted_pct;     /* sampled pairs in order to try insertion */
+    unsigned int dup_pct;           /* sampled pairs equal to prefer introsort */
+};
+
+extern struct sort_auto_table sort_auto_table;
+extern int sort_auto_last;
+extern atomic64_t sort_auto_stats[NR_SORT_STRATEGIES];
+extern const char *const sort_strategy_names[NR_SORT_STRATEGIES];
+
+/* Pick the fastest of the sorts above for this input, see auto.c */
+extern void sort_auto(void *base,
+                      size_t num,
+                      size_t size,
+                      cmp_func_t cmp_func,
+                      swap_func_t swap_func);
+
+/* A payload array for sort_kv_*(): num elements of size bytes each */
+struct sort_kv_payload {
+    void *base;
+    size_t size;
+};
+
+#define SORT_KV_MAX_PAYLOADS 8
+
+/* Sort u64 keys and permute the payload arrays along, see kv.c */
+extern int sort_kv_intro(u64 *keys,
+                         size_t num,
+                         const struct sort_kv_payload *payloads,
+                         size_t npayloads);
+
+extern int sort_kv_radix(u64 *keys,
+                         size_t num,
+                         const struct sort_kv_payload *payloads,
+                         size_t npayloads);
+
+/* Same as list_cmp_func_t in <linux/list_sort.h>, which older kernels lack */
+typedef int (*sort_list_cmp_func_t)(void *priv,
+                                    const struct list_head *a,
+                                    const struct list_head *b);
+
+/* Sort a list_head list, see list.c */
+extern void sort_list(void *priv,
+                      struct list_head *head,
+                      sort_list_cmp_func_t cmp);
+
+extern void sort_list_gather(void *priv,
+                             struct list_head *head,
+                             sort_list_cmp_func_t cmp);
+
 extern void sort_pdqsort(void *base,
                          size_t num,
                          size_t size,
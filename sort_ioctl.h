@@ -0,0 +1,84 @@
+#ifndef SORT_IOCTL_H
+#define SORT_IOCTL_H
+
+/*
+ * Asynchronous sort jobs on /dev/sort_test, shared by the module and the
+ * client.
+ *
+ * SORT_IOC_SUBMIT queues a batch of jobs on the module's worker pool and
+ * returns an id for each.  The data is copied in at submission, so the
+ * buffers can be refilled right away.  A finished job makes the device fd
+ * readable for poll() and, if one was given, signals an eventfd.
+ * SORT_IOC_REAP then copies sorted data back to the job buffers and
+ * returns the finished jobs' results without blocking.
+ */
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* Same order as the benchmark's timing columns */
+enum sort_job_algo {
+    SORT_JOB_HEAP,
+    SORT_JOB_INTRO,
+    SORT_JOB_BLOCK,
+    SORT_JOB_INSERTION,
+    SORT_JOB_AUTO,
+    NR_SORT_JOB_ALGOS
+};
+
+#define SORT_JOB_MAX_SIZE 4096      /* largest element size */
+#define SORT_JOB_MAX_INFLIGHT 256   /* per open file */
+#define SORT_JOB_MAX_INSERTION 4096 /* largest SORT_JOB_INSERTION job */
+
+/*
+ * Elements start with a u64 key in native byte order.  num is at most
+ * max_len, and SORT_JOB_MAX_INSERTION for the quadratic insertion sort,
+ * or SORT_IOC_SUBMIT fails with -EINVAL.  Jobs don't yield while sorting,
+ * so those bounds also bound how long a worker stays busy.  A job's data,
+ * num * size bytes, may be no more than max_len * 8, or SORT_IOC_SUBMIT
+ * fails with -E2BIG.
+ */
+struct sort_job {
+    __u64 buf;  /* user pointer to the elements, sorted in place */
+    __u64 num;  /* number of elements, see above */
+    __u32 size; /* element size, 8 .. SORT_JOB_MAX_SIZE */
+    __u32 algo; /* enum sort_job_algo */
+    __u64 id;   /* out: job id */
+};
+
+struct sort_submit {
+    __u64 jobs;    /* user pointer to an array of struct sort_job */
+    __u32 count;   /* in: jobs in the array; out: jobs queued */
+    __s32 eventfd; /* signalled once per finished job, or -1 */
+};
+
+struct sort_result {
+    __u64 id;
+    __u64 ns;     /* time spent sorting */
+    __s32 status; /* 0 or -errno */
+    __u32 pad;
+};
+
+struct sort_reap {
+    __u64 results; /* user pointer to an array of struct sort_result */
+    __u32 max;     /* room in the array */
+    __u32 count;   /* out: results returned */
+};
+
+#define SORT_IOC_MAGIC 'S'
+#define SORT_IOC_SUBMIT _IOWR(SORT_IOC_MAGIC, 1, struct sort_submit)
+#define SORT_IOC_REAP _IOWR(SORT_IOC_MAGIC, 2, struct sort_reap)
+
+#ifdef __KERNEL__
+#include <linux/fs.h>
+#include <linux/poll.h>
+
+extern int sort_job_init(void);
+extern void sort_job_exit(void);
+extern int sort_job_open(struct inode *inode, struct file *file);
+extern int sort_job_release(struct inode *inode, struct file *file);
+extern long sort_job_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+extern __poll_t sort_job_poll(struct file *file, poll_table *wait);
+#endif
+
+#endif
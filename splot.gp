@@ -0,0 +1,16 @@
+# swap kernels and full sorts by element size (client -s)
+reset
+set terminal png
+set title 'swap by element size'
+set xlabel 'element size(bytes)'
+set ylabel 'time(ns)'
+set logscale xy
+set output 'swap.png'
+
+plot \
+"swap.txt" using 1:2 with linespoints title 'swap (per swap)' , \
+'' using 1:3 with linespoints title 'swap words (per swap)' , \
+'' using 1:4 with linespoints title 'heap sort' , \
+'' using 1:5 with linespoints title 'heap sort, swap words' , \
+'' using 1:6 with linespoints title 'intro sort' , \
+'' using 1:7 with linespoints title 'intro sort, swap words'
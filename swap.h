@@ -0,0 +1,272 @@
+#ifndef SORT_SWAP_H
+#define SORT_SWAP_H
+
+/*
+ * Element swap kernels shared by the sorts.
+ *
+ * A sort picks a swap once with select_swap() and passes the result to
+ * do_swap() for every exchange.  The built-in swaps are small-integer
+ * sentinels rather than function pointers, so do_swap() inlines into the
+ * sort and dispatches with a few compares instead of an indirect call
+ * (and retpoline).
+ *
+ * There are three kinds:
+ * - word loops (SWAP_WORDS_64, SWAP_WORDS_32, SWAP_BYTES) for any size
+ *   that suits their alignment;
+ * - fixed-size swaps (SWAP_8 .. SWAP_64) for common 8-byte aligned sizes,
+ *   fully unrolled at compile time.  Kernel code can't touch the FPU/SIMD
+ *   registers without kernel_fpu_begin(), which costs far more than a
+ *   swap, so these are straight-line u64 moves;
+ * - SWAP_BLOCK for elements of SWAP_BLOCK_MIN bytes and more, which swaps
+ *   SWAP_BLOCK_CHUNK bytes at a time through a stack buffer with memcpy().
+ *   The chunk keeps the stack use bounded, so the copies are short: this
+ *   relies on memcpy() handling 128 bytes well at any alignment (on x86 it
+ *   uses "rep movsb" only on CPUs with FSRM), not on long string copies.
+ */
+
+#include <linux/minmax.h>
+#include <linux/string.h>
+#include <linux/types.h>
+
+#include "sort_impl.h"
+
+/**
+ * is_aligned - is this pointer & size okay for word-wide copying?
+ * @base: pointer to data
+ * @size: size of each element
+ * @align: required alignment (typically 4 or 8)
+ *
+ * Returns true if elements can be copied using word loads and stores.
+ * The size must be a multiple of the alignment, and the base address must
+ * be if we do not have CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS.
+ *
+ * For some reason, gcc doesn't know to optimize "if (a & mask || b & mask)"
+ * to "if ((a | b) & mask)", so we do that by hand.
+ */
+__attribute_const__ __always_inline static bool is_aligned(const void *base,
+                                                           size_t size,
+                                                           unsigned char align)
+{
+    unsigned char lsbits = (unsigned char) size;
+
+    (void) base;
+#ifndef CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS
+    lsbits |= (unsigned char) (uintptr_t) base;
+#endif
+    return (lsbits & (align - 1)) == 0;
+}
+
+/**
+ * swap_words_32 - swap two elements in 32-bit chunks
+ * @a: pointer to the first element to swap
+ * @b: pointer to the second element to swap
+ * @n: element size (must be a multiple of 4)
+ *
+ * Exchange the two objects in memory.  This exploits base+index addressing,
+ * which basically all CPUs have, to minimize loop overhead computations.
+ *
+ * For some reason, on x86 gcc 7.3.0 adds a redundant test of n at the
+ * bottom of the loop, even though the zero flag is stil valid from the
+ * subtract (since the intervening mov instructions don't alter the flags).
+ * Gcc 8.1.0 doesn't have that problem.
+ */
+static void swap_words_32(void *_a, void *_b, size_t n)
+{
+    char *a = _a, *b = _b;
+    do {
+        u32 t = *(u32 *) (a + (n -= 4));
+        *(u32 *) (a + n) = *(u32 *) (b + n);
+        *(u32 *) (b + n) = t;
+    } while (n);
+}
+
+/**
+ * swap_words_64 - swap two elements in 64-bit chunks
+ * @a: pointer to the first element to swap
+ * @b: pointer to the second element to swap
+ * @n: element size (must be a multiple of 8)
+ *
+ * Exchange the two objects in memory.  This exploits base+index
+ * addressing, which basically all CPUs have, to minimize loop overhead
+ * computations.
+ *
+ * We'd like to use 64-bit loads if possible.  If they're not, emulating
+ * one requires base+index+4 addressing which x86 has but most other
+ * processors do not.  If CONFIG_64BIT, we definitely have 64-bit loads,
+ * but it's possible to have 64-bit loads without 64-bit pointers (e.g.
+ * x32 ABI).  Are there any cases the kernel needs to worry about?
+ */
+static void swap_words_64(void *_a, void *_b, size_t n)
+{
+    char *a = _a, *b = _b;
+    do {
+#ifdef CONFIG_64BIT
+        u64 t = *(u64 *) (a + (n -= 8));
+        *(u64 *) (a + n) = *(u64 *) (b + n);
+        *(u64 *) (b + n) = t;
+#else
+        /* Use two 32-bit transfers to avoid base+index+4 addressing */
+        u32 t = *(u32 *) (a + (n -= 4));
+        *(u32 *) (a + n) = *(u32 *) (b + n);
+        *(u32 *) (b + n) = t;
+
+        t = *(u32 *) (a + (n -= 4));
+        *(u32 *) (a + n) = *(u32 *) (b + n);
+        *(u32 *) (b + n) = t;
+#endif
+    } while (n);
+}
+
+/**
+ * swap_bytes - swap two elements a byte at a time
+ * @a: pointer to the first element to swap
+ * @b: pointer to the second element to swap
+ * @n: element size
+ *
+ * This is the fallback if alignment doesn't allow using larger chunks.
+ */
+static void swap_bytes(void *a, void *b, size_t n)
+{
+    do {
+        char t = ((char *) a)[--n];
+        ((char *) a)[n] = ((char *) b)[n];
+        ((char *) b)[n] = t;
+    } while (n);
+}
+
+/* Fixed-size swap; with a constant @n the loop is unrolled completely */
+static __always_inline void swap_fixed(void *_a, void *_b, const size_t n)
+{
+    char *a = _a, *b = _b;
+
+    for (size_t i = 0; i < n; i += 8) {
+        u64 t = *(u64 *) (a + i);
+        *(u64 *) (a + i) = *(u64 *) (b + i);
+        *(u64 *) (b + i) = t;
+    }
+}
+
+#define SWAP_BLOCK_MIN 256
+#define SWAP_BLOCK_CHUNK 128
+
+/**
+ * swap_block - swap two large elements with memcpy()
+ * @a: pointer to the first element to swap
+ * @b: pointer to the second element to swap
+ * @n: element size
+ *
+ * Goes through a SWAP_BLOCK_CHUNK-byte buffer on the stack: three memcpy()
+ * calls per chunk rather than a loop of word swaps.
+ */
+static void swap_block(void *_a, void *_b, size_t n)
+{
+    char *a = _a, *b = _b;
+    char tmp[SWAP_BLOCK_CHUNK];
+
+    while (n) {
+        size_t c = min_t(size_t, n, sizeof(tmp));
+
+        memcpy(tmp, a, c);
+        memcpy(a, b, c);
+        memcpy(b, tmp, c);
+        a += c;
+        b += c;
+        n -= c;
+    }
+}
+
+/*
+ * The values are arbitrary as long as they can't be confused with
+ * a pointer, but small integers make for the smallest compare
+ * instructions.
+ */
+#define SWAP_WORDS_64 (swap_func_t) 0
+#define SWAP_WORDS_32 (swap_func_t) 1
+#define SWAP_BYTES (swap_func_t) 2
+#define SWAP_8 (swap_func_t) 3
+#define SWAP_16 (swap_func_t) 4
+#define SWAP_32 (swap_func_t) 5
+#define SWAP_64 (swap_func_t) 6
+#define SWAP_BLOCK (swap_func_t) 7
+
+/*
+ * The function pointer is last to make tail calls most efficient if the
+ * compiler decides not to inline this function.
+ */
+static __always_inline void do_swap(void *a,
+                                    void *b,
+                                    size_t size,
+                                    swap_func_t swap_func)
+{
+    if (swap_func == SWAP_8)
+        swap_fixed(a, b, 8);
+    else if (swap_func == SWAP_16)
+        swap_fixed(a, b, 16);
+    else if (swap_func == SWAP_WORDS_64)
+        swap_words_64(a, b, size);
+    else if (swap_func == SWAP_32)
+        swap_fixed(a, b, 32);
+    else if (swap_func == SWAP_64)
+        swap_fixed(a, b, 64);
+    else if (swap_func == SWAP_BLOCK)
+        swap_block(a, b, size);
+    else if (swap_func == SWAP_WORDS_32)
+        swap_words_32(a, b, size);
+    else if (swap_func == SWAP_BYTES)
+        swap_bytes(a, b, size);
+    else
+        swap_func(a, b, (int) size);
+}
+
+/**
+ * select_swap_words - pick a word-loop swap for this alignment
+ * @base: pointer to data
+ * @size: element size, or length of the runs to swap
+ *
+ * The result works for any length that is a multiple of @size; use it
+ * for swapping runs of several elements at once.
+ */
+static inline swap_func_t select_swap_words(const void *base, size_t size)
+{
+    if (is_aligned(base, size, 8))
+        return SWAP_WORDS_64;
+    if (is_aligned(base, size, 4))
+        return SWAP_WORDS_32;
+    return SWAP_BYTES;
+}
+
+/* Off: select_swap() returns the plain word loops, for benchmarking */
+extern bool sort_swap_specialize;
+
+/**
+ * select_swap - pick the fastest built-in swap for these elements
+ * @base: pointer to data
+ * @size: size of each element
+ *
+ * The result may be specialized for exactly @size bytes.
+ */
+static inline swap_func_t select_swap(const void *base, size_t size)
+{
+    swap_func_t words = select_swap_words(base, size);
+
+    if (!sort_swap_specialize)
+        return words;
+    if (size >= SWAP_BLOCK_MIN)
+        return SWAP_BLOCK;
+    if (words != SWAP_WORDS_64)
+        return words;
+    switch (size) {
+    case 8:
+        return SWAP_8;
+    case 16:
+        return SWAP_16;
+    case 32:
+        return SWAP_32;
+    case 64:
+        return SWAP_64;
+    default:
+        return SWAP_WORDS_64;
+    }
+}
+
+#endif
@@ -2,24 +2,161 @@
 #include <linux/init.h>
 #include <linux/slab.h>
 #include <linux/fs.h>
+#include <linux/hrtimer.h>
 #include <linux/cdev.h>
+#include <linux/completion.h>
+#include <linux/kthread.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <asm/unaligned.h>
 
 #include "sort_impl.h"
+#include "sort_ioctl.h"
+#include "swap.h"
 
 MODULE_LICENSE("Dual BSD/GPL");
 
 #define DEV_NAME "sort_test"
 #define LEN 20000
 
+/*
+ * Largest array the benchmark will sort.  Sizes in the 10^6 - 10^8 range
+ * are where TLB and cache misses dominate, so this is a load-time knob
+ * instead of a constant, e.g. "insmod sort_test.ko max_len=100000000".
+ */
+unsigned long max_len = LEN; /* also bounds async jobs, see job.c */
+module_param(max_len, ulong, 0444);
+MODULE_PARM_DESC(max_len, "Largest number of elements to sort (default 20000)");
+
+static bool hugepage;
+module_param(hugepage, bool, 0444);
+MODULE_PARM_DESC(hugepage, "Back the test arrays with huge pages");
+
+/*
+ * Input distributions.  "dist" can be changed between runs through
+ * /sys/module/sort_test/parameters/dist.
+ */
+enum {
+    DIST_RANDOM,
+    DIST_SORTED,
+    DIST_REVERSED,
+    DIST_FEW_UNIQUE,
+    DIST_NEARLY_SORTED,
+    NR_DISTS
+};
+
+static int dist = DIST_RANDOM;
+module_param(dist, int, 0644);
+MODULE_PARM_DESC(dist,
+                 "Input distribution: 0 random, 1 sorted, 2 reversed, "
+                 "3 few unique, 4 nearly sorted");
+
+/* See sort_impl.h; e.g. resched_work=1024 resched_ns=1000000 */
+unsigned long sort_resched_work;
+module_param_named(resched_work, sort_resched_work, ulong, 0644);
+MODULE_PARM_DESC(resched_work, "Sort work units between yield checks (0: never)");
+
+unsigned long sort_resched_ns;
+module_param_named(resched_ns, sort_resched_ns, ulong, 0644);
+MODULE_PARM_DESC(resched_ns, "Time budget between yields in ns (0: work only)");
+
+static bool probe;
+module_param(probe, bool, 0644);
+MODULE_PARM_DESC(probe, "Measure scheduling latency on the sorting CPU");
+
+/*
+ * Elements are elem_size bytes with the u64 key in front, so the sorts can
+ * be timed on large and (with odd sizes) unaligned elements.
+ */
+static unsigned long elem_size = sizeof(uint64_t);
+module_param(elem_size, ulong, 0644);
+MODULE_PARM_DESC(elem_size, "Element size in bytes, 8 .. 4096 (default 8)");
+
+/*
+ * Bit i selects sort_algos[i].  By default the array sorts but insertion
+ * sort; the benchmark-only columns from "swap" on are off.
+ */
+static unsigned int algo_mask = 0x77;
+module_param(algo_mask, uint, 0644);
+MODULE_PARM_DESC(algo_mask, "Algorithms to run, bit i = column i (default 0x77)");
+
+/* See select_swap() in swap.h */
+bool sort_swap_specialize = true;
+module_param_named(swap_specialize, sort_swap_specialize, bool, 0644);
+MODULE_PARM_DESC(swap_specialize,
+                 "Use the size-specialized and memcpy swaps (default on)");
+
+static bool list_shuffle = true;
+module_param(list_shuffle, bool, 0644);
+MODULE_PARM_DESC(list_shuffle,
+                 "Link list benchmark nodes in random memory order (default on)");
+
+/*
+ * Regression runs (client -B/-C): a fixed seed makes the input, and so the
+ * comparison and swap counts, the same on every read.
+ */
+static unsigned long rng_seed;
+module_param(rng_seed, ulong, 0644);
+MODULE_PARM_DESC(rng_seed, "Reseed the input generator before each read (0: don't)");
+
+static bool count_moves;
+module_param(count_moves, bool, 0644);
+MODULE_PARM_DESC(count_moves, "Count swaps with a swap_func callback (slower)");
+
+static unsigned int repeat = 1;
+module_param(repeat, uint, 0644);
+MODULE_PARM_DESC(repeat, "Runs per algorithm, the fastest is reported");
+
+/* The sort_auto() crossover table, as measured by "client -c" */
+module_param_named(auto_insertion_max,
+                   sort_auto_table.insertion_max,
+                   ulong,
+                   0644);
+module_param_array_named(auto_heap_min_size,
+                         sort_auto_table.heap_min_size,
+                         ulong,
+                         NULL,
+                         0644);
+module_param_named(auto_presorted_pct,
+                   sort_auto_table.presorted_pct,
+                   uint,
+                   0644);
+module_param_named(auto_dup_pct, sort_auto_table.dup_pct, uint, 0644);
+
+/* sort_auto() instrumentation */
+module_param_named(auto_last, sort_auto_last, int, 0444);
+MODULE_PARM_DESC(auto_last, "Strategy last chosen by sort_auto (enum sort_strategy)");
+static int auto_stats_get(char *buf, const struct kernel_param *kp)
+{
+    int len = 0;
+
+    for (int i = 0; i < NR_SORT_STRATEGIES; i++)
+        len += scnprintf(buf + len, PAGE_SIZE - len, "%s%lld", i ? "," : "",
+                         atomic64_read(&sort_auto_stats[i]));
+    return len + scnprintf(buf + len, PAGE_SIZE - len, "\n");
+}
+
+static const struct kernel_param_ops auto_stats_ops = {
+    .get = auto_stats_get,
+};
+
+module_param_cb(auto_stats, &auto_stats_ops, NULL, 0444);
+MODULE_PARM_DESC(auto_stats, "Times sort_auto chose each strategy");
+
 extern void seed(uint64_t, uint64_t);
 extern void jump(void);
 extern uint64_t next(void);
 
-int cmp_num = 0;
+size_t cmp_num = 0;
+static size_t move_num;
+
 static int cmpint64(const void *a, const void *b)
 {
-    uint64_t a_val = *(uint64_t *) a;
-    uint64_t b_val = *(uint64_t *) b;
+    uint64_t a_val = get_unaligned((const uint64_t *) a);
+    uint64_t b_val = get_unaligned((const uint64_t *) b);
     cmp_num++;
     if (a_val > b_val)
         return 1;
@@ -28,47 +165,586 @@ static int cmpint64(const void *a, const void *b)
     return -1;
 }
 
+/* Not a built-in swap, so the sorts call it for every swap */
+static void swap_count(void *a, void *b, int size)
+{
+    move_num++;
+    do_swap(a, b, size, select_swap_words(a, size));
+}
+
+/* Sort outside a measurement, leaving the comparison count alone */
+static void sort_uncounted(void *arr, size_t num, size_t esize)
+{
+    size_t cmps = cmp_num;
+
+    sort_intro(arr, num, esize, cmpint64, NULL);
+    cmp_num = cmps;
+}
+
+/*
+ * kvmalloc() falls back to vmalloc() for the large arrays, which are then
+ * mapped with 4K pages.  vmalloc_huge() maps them with PMD-sized pages
+ * where the architecture allows it, so the large-N runs can be repeated
+ * with far fewer TLB misses.
+ */
+static void *sort_buf_alloc(size_t num, size_t size)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+    if (hugepage)
+        return vmalloc_huge(array_size(num, size), GFP_KERNEL);
+#endif
+    return kvmalloc_array(num, size, GFP_KERNEL);
+}
+
+static inline uint64_t get_key(const void *arr, size_t i, size_t esize)
+{
+    return get_unaligned((const uint64_t *) ((const char *) arr + i * esize));
+}
+
+static inline void set_key(void *arr, size_t i, size_t esize, uint64_t key)
+{
+    put_unaligned(key, (uint64_t *) ((char *) arr + i * esize));
+}
+
+static void fill_array(void *arr, size_t num, size_t esize)
+{
+    switch (dist) {
+    case DIST_SORTED:
+        for (size_t i = 0; i < num; i++)
+            set_key(arr, i, esize, i);
+        break;
+    case DIST_REVERSED:
+        for (size_t i = 0; i < num; i++)
+            set_key(arr, i, esize, num - i);
+        break;
+    case DIST_FEW_UNIQUE:
+        for (size_t i = 0; i < num; i++)
+            set_key(arr, i, esize, next() % 16);
+        break;
+    case DIST_NEARLY_SORTED:
+        /* sorted, then one element in a hundred swapped at random */
+        for (size_t i = 0; i < num; i++)
+            set_key(arr, i, esize, i);
+        for (size_t i = 0; i < num / 100; i++) {
+            size_t a = next() % num, b = next() % num;
+            uint64_t t = get_key(arr, a, esize);
+
+            set_key(arr, a, esize, get_key(arr, b, esize));
+            set_key(arr, b, esize, t);
+        }
+        break;
+    default:
+        for (size_t i = 0; i < num; i++)
+            set_key(arr, i, esize, next());
+        break;
+    }
+}
+
+static bool check_sorted(const void *arr,
+                         size_t num,
+                         size_t esize,
+                         const char *name)
+{
+    for (size_t i = 1; i < num; i++) {
+        if (get_key(arr, i - 1, esize) > get_key(arr, i, esize)) {
+            pr_err("%zu test has failed in %s\n", num, name);
+            return false;
+        }
+    }
+    return true;
+}
+
+#define PROBE_PERIOD_US 100
+
+struct latency_probe {
+    struct task_struct *task;
+    struct completion started;
+    u64 max_lat;
+};
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+/*
+ * Sleep PROBE_PERIOD_US at a time on the sorting CPU and record how late
+ * each wakeup is.  A sort that never yields keeps the probe off the CPU
+ * until it is done, so the worst case is about the length of the sort.
+ *
+ * This is usleep_range() spelled out, so that the sort is let go only once
+ * the first timer is armed.
+ */
+static int latency_probe_fn(void *data)
+{
+    struct latency_probe *lp = data;
+    struct hrtimer_sleeper t;
+    bool armed = false;
+
+    hrtimer_init_sleeper_on_stack(&t, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    while (!kthread_should_stop()) {
+        s64 lat = ktime_get_ns();
+
+        set_current_state(TASK_INTERRUPTIBLE);
+        hrtimer_set_expires(&t.timer, us_to_ktime(PROBE_PERIOD_US));
+        hrtimer_sleeper_start_expires(&t, HRTIMER_MODE_REL);
+        if (!armed) {
+            complete(&lp->started);
+            armed = true;
+        }
+        if (t.task && !kthread_should_stop())
+            schedule();
+        hrtimer_cancel(&t.timer);
+        __set_current_state(TASK_RUNNING);
+
+        /* negative when woken early by kthread_stop() */
+        lat = ktime_get_ns() - lat - PROBE_PERIOD_US * NSEC_PER_USEC;
+        if (lat > 0 && (u64) lat > lp->max_lat)
+            lp->max_lat = lat;
+    }
+    destroy_hrtimer_on_stack(&t.timer);
+    return 0;
+}
+
+/*
+ * The caller sorts between latency_probe_start() and latency_probe_stop(),
+ * pinned with migrate_disable() to the CPU the probe is bound to; it may
+ * still sleep, which it does until the probe is armed.
+ */
+static int latency_probe_start(struct latency_probe *lp)
+{
+    lp->max_lat = 0;
+    init_completion(&lp->started);
+    lp->task = kthread_create(latency_probe_fn, lp, "sort_probe");
+    if (IS_ERR(lp->task))
+        return PTR_ERR(lp->task);
+    migrate_disable();
+    kthread_bind(lp->task, raw_smp_processor_id());
+    wake_up_process(lp->task);
+    wait_for_completion(&lp->started);
+    return 0;
+}
+
+static u64 latency_probe_stop(struct latency_probe *lp)
+{
+    kthread_stop(lp->task);
+    migrate_enable();
+    return lp->max_lat;
+}
+#else
+/* Before 5.11 migrate_disable() disabled preemption, so no sleeping */
+static int latency_probe_start(struct latency_probe *lp)
+{
+    return -EOPNOTSUPP;
+}
+
+static u64 latency_probe_stop(struct latency_probe *lp)
+{
+    return 0;
+}
+#endif
+
+/*
+ * Key/value sorts: split the elements into a key array and one payload
+ * array of esize - 8 bytes, sort those, and write the keys back for
+ * check_sorted().  Each payload is a function of its key, so checking the
+ * payloads after the sort shows they moved in lockstep with the keys.  Only
+ * the sort itself is timed, so this compares directly with sorting the
+ * array of structs.
+ */
+static inline u8 kv_payload_byte(uint64_t key, size_t j)
+{
+    return (u8) (key >> (j % 8 * 8)) ^ (u8) j;
+}
+
+static s64 bench_kv(void *arr, size_t num, size_t esize, bool radix)
+{
+    struct sort_kv_payload payload = {NULL, esize - sizeof(uint64_t)};
+    uint64_t *keys;
+    ktime_t kt = 0;
+    u8 *p;
+    int rc = 0;
+
+    keys = sort_buf_alloc(num, sizeof(*keys));
+    if (payload.size)
+        payload.base = sort_buf_alloc(num, payload.size);
+    if (!keys || (payload.size && !payload.base)) {
+        rc = -ENOMEM;
+        goto out;
+    }
+    p = payload.base;
+    for (size_t i = 0; i < num; i++) {
+        keys[i] = get_key(arr, i, esize);
+        for (size_t j = 0; j < payload.size; j++)
+            *p++ = kv_payload_byte(keys[i], j);
+    }
+
+    kt = ktime_get();
+    if (radix)
+        rc = sort_kv_radix(keys, num, &payload, !!payload.size);
+    else
+        rc = sort_kv_intro(keys, num, &payload, !!payload.size);
+    kt = ktime_sub(ktime_get(), kt);
+
+    p = payload.base;
+    for (size_t i = 0; i < num; i++) {
+        set_key(arr, i, esize, keys[i]);
+        for (size_t j = 0; j < payload.size; j++, p++) {
+            if (*p != kv_payload_byte(keys[i], j)) {
+                pr_err("%s: payload %zu doesn't match its key\n",
+                       radix ? "kv radix sort" : "kv introsort", i);
+                rc = -EILSEQ;
+                goto out;
+            }
+        }
+    }
+out:
+    kvfree(keys);
+    kvfree(payload.base);
+    return rc < 0 ? rc : ktime_to_ns(kt);
+}
+
+static s64 bench_kv_intro(void *arr, size_t num, size_t esize)
+{
+    return bench_kv(arr, num, esize, false);
+}
+
+static s64 bench_kv_radix(void *arr, size_t num, size_t esize)
+{
+    return bench_kv(arr, num, esize, true);
+}
+
+/*
+ * Swap throughput: sort the array untimed, then time reversing it twice,
+ * which is num swaps (as in a sort: mirrored pairs, cold and hot
+ * elements) and leaves it sorted again.  The "swap" column uses the swap
+ * the sorts pick, "swap words" the plain word loop it replaced.
+ */
+static s64 bench_swap(void *arr, size_t num, size_t esize, bool specialize)
+{
+    swap_func_t swap_func = specialize ? select_swap(arr, esize)
+                                       : select_swap_words(arr, esize);
+    char *base = arr;
+    ktime_t kt;
+
+    sort_uncounted(arr, num, esize);
+    kt = ktime_get();
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0, j = num - 1; i < j; i++, j--)
+            do_swap(base + i * esize, base + j * esize, esize, swap_func);
+    }
+    return ktime_to_ns(ktime_sub(ktime_get(), kt));
+}
+
+static s64 bench_swap_select(void *arr, size_t num, size_t esize)
+{
+    return bench_swap(arr, num, esize, true);
+}
+
+static s64 bench_swap_words(void *arr, size_t num, size_t esize)
+{
+    return bench_swap(arr, num, esize, false);
+}
+
+struct list_node {
+    struct list_head list;
+    uint64_t key;
+};
+
+static int cmp_list_node(void *priv,
+                         const struct list_head *a,
+                         const struct list_head *b)
+{
+    return cmpint64(&list_entry(a, struct list_node, list)->key,
+                    &list_entry(b, struct list_node, list)->key);
+}
+
+/*
+ * List sorts: put the keys into a list of nodes, sort it, and copy the keys
+ * back in list order.  With list_shuffle the nodes are linked in a random
+ * order of their addresses, as in a long-lived list, so walking the list
+ * misses the cache (and the TLB) once the nodes outgrow it.
+ */
+static s64 bench_list(void *arr, size_t num, size_t esize, bool gather)
+{
+    struct list_node *nodes, *node;
+    size_t *order;
+    ktime_t kt;
+    LIST_HEAD(head);
+    size_t i;
+
+    nodes = sort_buf_alloc(num, sizeof(*nodes));
+    order = sort_buf_alloc(num, sizeof(*order));
+    if (!nodes || !order) {
+        kvfree(nodes);
+        kvfree(order);
+        return -ENOMEM;
+    }
+    for (i = 0; i < num; i++)
+        order[i] = i;
+    if (list_shuffle) {
+        for (i = num - 1; i > 0; i--) {
+            /* swap() evaluates its arguments twice: draw j once */
+            size_t j = next() % (i + 1);
+
+            swap(order[i], order[j]);
+        }
+    }
+    for (i = 0; i < num; i++) {
+        node = &nodes[order[i]];
+        node->key = get_key(arr, i, esize);
+        list_add_tail(&node->list, &head);
+    }
+    kvfree(order);
+
+    kt = ktime_get();
+    if (gather)
+        sort_list_gather(NULL, &head, cmp_list_node);
+    else
+        sort_list(NULL, &head, cmp_list_node);
+    kt = ktime_sub(ktime_get(), kt);
+
+    i = 0;
+    list_for_each_entry(node, &head, list)
+        set_key(arr, i++, esize, node->key);
+    kvfree(nodes);
+    return ktime_to_ns(kt);
+}
+
+static s64 bench_list_merge(void *arr, size_t num, size_t esize)
+{
+    return bench_list(arr, num, esize, false);
+}
+
+static s64 bench_list_gather(void *arr, size_t num, size_t esize)
+{
+    return bench_list(arr, num, esize, true);
+}
+
+/*
+ * Sorting with duplicates dropped: sort_unique() against sort_intro() and
+ * a separate pass.  Both work on a copy and check that they kept a
+ * strictly increasing run, then sort arr for check_sorted().
+ */
+static s64 bench_unique(void *arr, size_t num, size_t esize, bool fused)
+{
+    char *buf = sort_buf_alloc(num, esize);
+    size_t n, i;
+    ktime_t kt;
+
+    if (!buf)
+        return -ENOMEM;
+    memcpy(buf, arr, num * esize);
+
+    kt = ktime_get();
+    if (fused) {
+        n = sort_unique(buf, num, esize, cmpint64, NULL);
+    } else {
+        sort_intro(buf, num, esize, cmpint64, NULL);
+        for (i = 1, n = 1; i < num; i++) {
+            if (cmpint64(buf + (n - 1) * esize, buf + i * esize)) {
+                if (n != i)
+                    memcpy(buf + n * esize, buf + i * esize, esize);
+                n++;
+            }
+        }
+    }
+    kt = ktime_sub(ktime_get(), kt);
+
+    for (i = 1; i < n; i++) {
+        if (get_key(buf, i - 1, esize) >= get_key(buf, i, esize)) {
+            pr_err("%s: not strictly increasing at %zu\n",
+                   fused ? "unique" : "sort + dedup", i);
+            break;
+        }
+    }
+    kvfree(buf);
+    sort_uncounted(arr, num, esize);
+    return ktime_to_ns(kt);
+}
+
+static s64 bench_unique_fused(void *arr, size_t num, size_t esize)
+{
+    return bench_unique(arr, num, esize, true);
+}
+
+static s64 bench_unique_dedup(void *arr, size_t num, size_t esize)
+{
+    return bench_unique(arr, num, esize, false);
+}
+
+/*
+ * An expensive comparator, standing in for string keys: the keys are
+ * printed as zero-padded decimal strings, which sort like the numbers, and
+ * those are compared.  The key itself is an order-preserving prefix.
+ */
+static int cmp_decimal(const void *a, const void *b)
+{
+    char sa[21], sb[21];
+
+    cmp_num++;
+    snprintf(sa, sizeof(sa), "%020llu",
+             (unsigned long long) get_unaligned((const uint64_t *) a));
+    snprintf(sb, sizeof(sb), "%020llu",
+             (unsigned long long) get_unaligned((const uint64_t *) b));
+    return strcmp(sa, sb);
+}
+
+static u64 prefix_key(const void *elem)
+{
+    return get_unaligned((const uint64_t *) elem);
+}
+
+/*
+ * Expensive comparisons: introsort against sort_prefix().  The comparison
+ * counts in the read buffer show the comparator calls saved.
+ */
+static s64 bench_decimal(void *arr, size_t num, size_t esize, bool prefix)
+{
+    ktime_t kt = ktime_get();
+    int rc = 0;
+
+    if (prefix)
+        rc = sort_prefix(arr, num, esize, cmp_decimal, NULL, prefix_key);
+    else
+        sort_intro(arr, num, esize, cmp_decimal, NULL);
+    kt = ktime_sub(ktime_get(), kt);
+    return rc < 0 ? rc : ktime_to_ns(kt);
+}
+
+static s64 bench_decimal_intro(void *arr, size_t num, size_t esize)
+{
+    return bench_decimal(arr, num, esize, false);
+}
+
+static s64 bench_decimal_prefix(void *arr, size_t num, size_t esize)
+{
+    return bench_decimal(arr, num, esize, true);
+}
+
+/*
+ * Either a sort with the usual interface, timed around the call, or a
+ * bench function for sorts that need their own data layout: it sorts the
+ * elements in arr (at least their keys) and returns the time it took.
+ */
+struct sort_algo {
+    const char *name;
+    void (*sort)(void *base,
+                 size_t num,
+                 size_t size,
+                 cmp_func_t cmp_func,
+                 swap_func_t swap_func);
+    s64 (*bench)(void *arr, size_t num, size_t esize);
+};
+
+/* Column order of the timing output, and bit order of algo_mask */
+static const struct sort_algo sort_algos[] = {
+    {"heapsort", sort_heap},
+    {"introsort", sort_intro},
+    {"block merge sort", sort_block},
+    {"insertion sort", sort_insertion},
+    {"auto", sort_auto},
+    {"kv introsort", NULL, bench_kv_intro},
+    {"kv radix sort", NULL, bench_kv_radix},
+    {"swap", NULL, bench_swap_select},
+    {"swap words", NULL, bench_swap_words},
+    {"list sort", NULL, bench_list_merge},
+    {"list gather sort", NULL, bench_list_gather},
+    {"unique", NULL, bench_unique_fused},
+    {"sort + dedup", NULL, bench_unique_dedup},
+    {"introsort, decimal cmp", NULL, bench_decimal_intro},
+    {"prefix sort, decimal cmp", NULL, bench_decimal_prefix},
+};
+
+/* Async jobs pick their algorithm by column, from the first one */
+static_assert(ARRAY_SIZE(sort_algos) >= NR_SORT_JOB_ALGOS);
+
 static dev_t sort_dev = 0;
 static struct cdev *sort_cdev;
 static struct class *sort_class;
-static ktime_t kt_heap, kt_intro;
+
+/*
+ * Sort (*offset + 1) elements of the current distribution with every
+ * algorithm selected by algo_mask.  The return value is the total number of
+ * comparisons.  As far as it fits, the buffer receives a u64 array of the
+ * elapsed times in nanoseconds, one per algorithm (0 if not run), followed
+ * by the worst scheduling latency seen by the probe during each sort (0 if
+ * the probe is off), the comparisons of one run of each algorithm, and with
+ * count_moves its swaps (sorts that don't take a swap_func report 0).
+ */
 static ssize_t sort_read(struct file *file,
-                         char *buf,
+                         char __user *buf,
                          size_t size,
                          loff_t *offset)
 {
-    uint64_t *arr, *arr_copy;
-    arr = kmalloc_array(LEN, sizeof(*arr), GFP_KERNEL);
-    arr_copy = kmalloc_array(LEN, sizeof(*arr_copy), GFP_KERNEL);
-    for (int i = 0; i < (*offset) + 1; i++) {
-        uint64_t val = next();
-        arr[i] = val;
+    size_t num = (*offset) + 1;
+    size_t esize = max_t(size_t, elem_size, sizeof(uint64_t));
+    unsigned int runs = max(repeat, 1U), mask = algo_mask;
+    void *arr, *arr_copy;
+    u64 res[4][ARRAY_SIZE(sort_algos)] = {0};
+    swap_func_t swap_func = count_moves ? swap_count : NULL;
+    struct latency_probe lp;
+    bool probing = probe;
+    int rc;
+
+    /* same bound as jobs; kvmalloc() warns above INT_MAX bytes */
+    if (esize > SORT_JOB_MAX_SIZE)
+        return -EINVAL;
+    if (num > INT_MAX / esize)
+        return -E2BIG;
+    arr = sort_buf_alloc(num, esize);
+    arr_copy = sort_buf_alloc(num, esize);
+    if (!arr || !arr_copy) {
+        kvfree(arr);
+        kvfree(arr_copy);
+        return -ENOMEM;
     }
-    memcpy(arr_copy, arr, sizeof(int64_t) * LEN);
+    if (rng_seed)
+        seed(rng_seed, 1618033989);
+    fill_array(arr, num, esize);
     cmp_num = 0;
-    kt_heap = ktime_get();
-    sort_heap(arr, (*offset) + 1, sizeof(*arr), cmpint64, NULL);
-    kt_heap = ktime_sub(ktime_get(), kt_heap);
-    ktime_to_us(kt_heap);
-    for (int i = 0; i < (*offset); i++) {
-        if (arr[i] > arr[i + 1]) {
-            pr_err("%d test has failed in heapsort\n", (*offset + 1));
-            break;
-        }
-    }
-    kt_intro = ktime_get();
-    sort_intro(arr_copy, (*offset) + 1, sizeof(*arr_copy), cmpint64, NULL);
-    kt_intro = ktime_sub(ktime_get(), kt_intro);
-    ktime_to_us(kt_intro);
-    for (int i = 0; i < (*offset); i++) {
-        if (arr[i] > arr[i + 1]) {
-            pr_err("%d test has failed in introsort\n", (*offset + 1));
-            break;
+    pr_info("%zu", num);
+    for (int i = 0; i < ARRAY_SIZE(sort_algos); i++) {
+        size_t cmps = cmp_num;
+
+        if (!(mask & BIT(i)))
+            continue;
+        res[0][i] = U64_MAX;
+        move_num = 0;
+        for (unsigned int r = 0; r < runs; r++) {
+            s64 ns;
+
+            memcpy(arr_copy, arr, esize * num);
+            if (probing && (rc = latency_probe_start(&lp)) < 0)
+                goto out;
+            if (sort_algos[i].sort) {
+                ktime_t kt = ktime_get();
+
+                sort_algos[i].sort(arr_copy, num, esize, cmpint64, swap_func);
+                ns = ktime_to_ns(ktime_sub(ktime_get(), kt));
+            } else {
+                ns = sort_algos[i].bench(arr_copy, num, esize);
+            }
+            if (probing)
+                res[1][i] = max(res[1][i], latency_probe_stop(&lp));
+            if (ns < 0) {
+                rc = ns;
+                goto out;
+            }
+            res[0][i] = min_t(u64, res[0][i], ns);
         }
+        res[2][i] = (cmp_num - cmps) / runs;
+        res[3][i] = move_num / runs;
+        check_sorted(arr_copy, num, esize, sort_algos[i].name);
     }
-    printk("%lld %llu %llu\n", (*offset) + 1, kt_heap, kt_intro);
-    kfree(arr);
-    kfree(arr_copy);
+    for (int i = 0; i < ARRAY_SIZE(sort_algos); i++)
+        pr_cont(" %llu", res[0][i]);
+    pr_cont("\n");
+    rc = 0;
+out:
+    kvfree(arr);
+    kvfree(arr_copy);
+    if (rc < 0)
+        return rc;
+
+    if (copy_to_user(buf, res, min(size, sizeof(res))))
+        return -EFAULT;
     return cmp_num;
 }
 
@@ -84,12 +760,12 @@ static loff_t sort_lseek(struct file *file, loff_t offset, int orig)
         new_pos = file->f_pos + offset;
         break;
     case 2: /* SEEK_END: */
-        new_pos = LEN - offset;
+        new_pos = max_len - 1 - offset;
         break;
     }
 
-    if (new_pos > LEN)
-        new_pos = LEN;  // max case
+    if (new_pos > (loff_t) max_len - 1)
+        new_pos = max_len - 1;  // max case
     if (new_pos < 0)
         new_pos = 0;        // min case
     file->f_pos = new_pos;  // This is what we'll use now
@@ -97,15 +773,32 @@ static loff_t sort_lseek(struct file *file, loff_t offset, int orig)
 }
 
 const struct file_operations sort_fops = {
+    .owner = THIS_MODULE,
+    .open = sort_job_open,
+    .release = sort_job_release,
     .read = sort_read,
-    .llseek = sort_lseek
+    .llseek = sort_lseek,
+    .unlocked_ioctl = sort_job_ioctl,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 5, 0)
+    .compat_ioctl = compat_ptr_ioctl, /* the ioctl structs are fixed-width */
+#endif
+    .poll = sort_job_poll,
 };
 
 static int sort_init(void)
 {
     int rc = 0;
 
+    if (!max_len)
+        return -EINVAL;
     seed(314159265, 1618033989);  // Initialize PRNG with pi and phi.
+
+    rc = sort_job_init();
+    if (rc < 0) {
+        printk(KERN_ALERT "Failed to create the sort job workqueue");
+        return rc;
+    }
+
     // Let's register the device
     // This will dynamically allocate the major number
     rc = alloc_chrdev_region(&sort_dev, 0, 1, DEV_NAME);
@@ -114,7 +807,7 @@ static int sort_init(void)
         printk(KERN_ALERT
                "Failed to register the fibonacci char device. rc = %i",
                rc);
-        return rc;
+        goto failed_chrdev;
     }
 
     sort_cdev = cdev_alloc();
@@ -152,6 +845,8 @@ failed_class_create:
     cdev_del(sort_cdev);
 failed_cdev:
     unregister_chrdev_region(sort_dev, 1);
+failed_chrdev:
+    sort_job_exit();
     return rc;
 }
 
@@ -161,6 +856,7 @@ static void sort_exit(void)
     class_destroy(sort_class);
     cdev_del(sort_cdev);
     unregister_chrdev_region(sort_dev, 1);
+    sort_job_exit();
 }
 
 module_init(sort_init);